@@ -1,25 +1,47 @@
 #include "arena.h"
 
 #include <assert.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena_file.h"
+#include "bump_allocator.h"
+#include "colors.h"
+#include "lurker_logic.h"
+#include "rng.h"
 #include "utils.h"
 
-byte are_rooms_overlapping(RoomSeed* a, RoomSeed* b, float pad_t, float pad_r,
-                           float pad_b, float pad_l) {
-  /* TODO: These could (should?) be cached */
-  float a_r = a->center_x + a->radius_r + pad_r;
-  float a_l = a->center_x - a->radius_l - pad_l;
-  float a_t = a->center_y + a->radius_t + pad_t;
-  float a_b = a->center_y - a->radius_b - pad_b;
-  float b_r = b->center_x + b->radius_r;
-  float b_l = b->center_x - b->radius_l;
-  float b_t = b->center_y + b->radius_t;
-  float b_b = b->center_y - b->radius_b;
+const TileProperties TILE_PROPERTIES[ARENA_TILE_COUNT] = {
+    /* FLOOR */ {' ', FLOOR_COLOR_CODE, 1, 1, 1, SPAWNS_NOTHING},
+    /* FLOOR_MOSS */ {',', FLOOR_COLOR_CODE, 1, 1, 1, SPAWNS_NOTHING},
+    /* FLOOR_ROCKY */ {'.', FLOOR_COLOR_CODE, 1, 1, 1, SPAWNS_NOTHING},
+    /* FLOOR_SMOOTH */ {' ', FLOOR_COLOR_CODE, 1, 1, 1, SPAWNS_NOTHING},
+    /* FLOOR_WATER */ {'~', FLOOR_COLOR_CODE, 1, 1, 0, SPAWNS_NOTHING},
+    /* NO_SPAWN_FLOOR */ {' ', FLOOR_COLOR_CODE, 1, 1, 0, SPAWNS_NOTHING},
+    /* WALL */ {'#', WALL_COLOR_CODE, 0, 0, 0, SPAWNS_NOTHING},
+    /* WALL_MOSS */ {'#', WALL_COLOR_CODE, 0, 0, 0, SPAWNS_NOTHING},
+    /* WALL_ROCKY */ {'#', WALL_COLOR_CODE, 0, 0, 0, SPAWNS_NOTHING},
+    /* WALL_SMOOTH */ {'#', WALL_COLOR_CODE, 0, 0, 0, SPAWNS_NOTHING},
+    /* PLAYER_SPAWN */ {'P', FLOOR_COLOR_CODE, 1, 1, 0, SPAWNS_PLAYER},
+    /* LURKER_SPAWN */ {'E', FLOOR_COLOR_CODE, 1, 1, 0, SPAWNS_LURKER},
+    /* SIDE_OBJECTIVE */ {'$', SIDE_GOAL_COLOR_CODE, 1, 0, 0, SPAWNS_NOTHING},
+    /* END_OBJECTIVE */ {'%', EXIT_COLOR_CODE, 1, 0, 0, SPAWNS_NOTHING},
+};
+
+byte are_rooms_overlapping(Arena* arena, RoomSeed* a, RoomSeed* b,
+                           float pad_t, float pad_r, float pad_b, float pad_l) {
+  float a_r = a->bound_r + pad_r;
+  float a_l = a->bound_l - pad_l;
+  float a_t = a->bound_t + pad_t;
+  float a_b = a->bound_b - pad_b;
+  float b_r = b->bound_r;
+  float b_l = b->bound_l;
+  float b_t = b->bound_t;
+  float b_b = b->bound_b;
 
   /* FIXME: Bounds checks shouldn't be here, but it's the simplest for now. */
-  if (a_r >= ARENA_SIZE || a_l <= 0 || a_t >= ARENA_SIZE || a_b < 0) {
+  if (a_r >= arena->size_x || a_l <= 0 || a_t >= arena->size_y || a_b < 0) {
     return 1;
   }
 
@@ -31,54 +53,891 @@ byte are_rooms_overlapping(RoomSeed* a, RoomSeed* b, float pad_t, float pad_r,
   return 1;
 }
 
-void init_arena(Arena* arena, Player* player) {
+void update_room_bounds(RoomSeed* seed) {
+  seed->bound_r = seed->center_x + seed->radius_r;
+  seed->bound_l = seed->center_x - seed->radius_l;
+  seed->bound_t = seed->center_y + seed->radius_t;
+  seed->bound_b = seed->center_y - seed->radius_b;
+}
+
+/* How far apart the padded a is from b, positive exactly when the rooms
+// don't overlap as defined by are_rooms_overlapping.
+*/
+float get_rooms_clearance(RoomSeed* a, RoomSeed* b, float pad_t, float pad_r,
+                          float pad_b, float pad_l) {
+  float gap = b->bound_l - (a->bound_r + pad_r);
+  float d;
+  d = (a->bound_l - pad_l) - b->bound_r;
+  gap = d > gap ? d : gap;
+  d = b->bound_b - (a->bound_t + pad_t);
+  gap = d > gap ? d : gap;
+  d = (a->bound_b - pad_b) - b->bound_t;
+  gap = d > gap ? d : gap;
+  return gap;
+}
+
+/* Same as get_rooms_clearance, but against the arena bounds */
+float get_edge_clearance(Arena* arena, RoomSeed* a, float pad_t, float pad_r,
+                         float pad_b, float pad_l) {
+  float edge = arena->size_x - (a->bound_r + pad_r);
+  float d;
+  d = a->bound_l - pad_l;
+  edge = d < edge ? d : edge;
+  d = arena->size_y - (a->bound_t + pad_t);
+  edge = d < edge ? d : edge;
+  d = a->bound_b - pad_b;
+  edge = d < edge ? d : edge;
+  return edge;
+}
+
+/* Seed ids bucketed by the grid cell their center is in. Centers never move,
+// so this is built once, queries account for room extents separately.
+*/
+typedef struct {
+  uint cell_size;
+  uint size_x, size_y;
+  uint* cell_start;
+  uint* items;
+} SeedGrid;
+
+/* Lives in scratch memory, until the caller rewinds it */
+void build_seed_grid(SeedGrid* grid, Arena* arena, uint cell_size) {
+  grid->cell_size = cell_size;
+  grid->size_x = arena->size_x / cell_size + 1;
+  grid->size_y = arena->size_y / cell_size + 1;
+
+  uint cell_count = grid->size_x * grid->size_y;
+  grid->cell_start =
+      bump_calloc(&arena->scratch_memory, cell_count + 1, sizeof(uint));
+  grid->items = bump_alloc(&arena->scratch_memory,
+                           arena->room_seed_count * sizeof(uint));
+
+  /* Counting sort, cell_start[c] ends up as the first index of cell c */
+  uint i, cell;
+  for (i = 0; i < arena->room_seed_count; i++) {
+    RoomSeed* seed = &arena->room_seeds[i];
+    cell = seed->center_x / cell_size +
+           seed->center_y / cell_size * grid->size_x;
+    grid->cell_start[cell + 1] += 1;
+  }
+
+  for (cell = 0; cell < cell_count; cell++) {
+    grid->cell_start[cell + 1] += grid->cell_start[cell];
+  }
+
+  uint* fill = bump_alloc(&arena->scratch_memory, cell_count * sizeof(uint));
+  memcpy(fill, grid->cell_start, cell_count * sizeof(uint));
+
+  for (i = 0; i < arena->room_seed_count; i++) {
+    RoomSeed* seed = &arena->room_seeds[i];
+    cell = seed->center_x / cell_size +
+           seed->center_y / cell_size * grid->size_x;
+    grid->items[fill[cell]++] = i;
+  }
+}
+
+uint get_grid_cell(SeedGrid* grid, float pos, uint size) {
+  if (pos <= 0) {
+    return 0;
+  }
+  uint cell = (uint)pos / grid->cell_size;
+  return cell >= size ? size - 1 : cell;
+}
+
+/* Bridson's Poisson-disk sampling, fills [min, max) with points that are at
+// least min_dist apart, until no more fit. A background grid with cells
+// small enough to hold a single point makes every distance check O(1), and
+// each active point gets a fixed number of attempts, so the whole run is
+// O(n) and always terminates. Returns the number of points written.
+// Its own bookkeeping comes from scratch and is released before returning.
+*/
+uint sample_poisson_disk(float min_x, float min_y, float max_x, float max_y,
+                         float min_dist, float* points_x, float* points_y,
+                         uint capacity, Rng* rng, BumpAllocator* scratch) {
+  const uint ATTEMPTS_PER_POINT = 30;
+  const int NO_POINT = -1;
+
+  float cell_size = min_dist / sqrt(2);
+  uint grid_x = (uint)((max_x - min_x) / cell_size) + 1;
+  uint grid_y = (uint)((max_y - min_y) / cell_size) + 1;
+  BumpMark mark = get_bump_mark(scratch);
+  int* grid = bump_alloc(scratch, grid_x * grid_y * sizeof(int));
+  uint* active = bump_alloc(scratch, capacity * sizeof(uint));
+
+  uint i;
+  for (i = 0; i < grid_x * grid_y; i++) {
+    grid[i] = NO_POINT;
+  }
+
+  uint point_count = 0;
+  uint active_count = 0;
+  float min_dist2 = min_dist * min_dist;
+
+  if (capacity > 0) {
+    points_x[0] = rand_f(rng, min_x, max_x);
+    points_y[0] = rand_f(rng, min_y, max_y);
+    grid[(uint)((points_x[0] - min_x) / cell_size) +
+         (uint)((points_y[0] - min_y) / cell_size) * grid_x] = 0;
+    active[active_count++] = 0;
+    point_count = 1;
+  }
+
+  while (active_count > 0 && point_count < capacity) {
+    uint active_idx = rand_ui(rng, 0, active_count);
+    uint parent = active[active_idx];
+    byte was_placed = 0;
+
+    uint attempt;
+    for (attempt = 0; attempt < ATTEMPTS_PER_POINT; attempt++) {
+      /* Uniformly in the annulus between min_dist and 2 * min_dist */
+      float angle = rand_f(rng, 0, 2 * PI);
+      float dist = rand_f(rng, min_dist, 2 * min_dist);
+      float x = points_x[parent] + cos(angle) * dist;
+      float y = points_y[parent] + sin(angle) * dist;
+
+      if (x < min_x || x >= max_x || y < min_y || y >= max_y) {
+        continue;
+      }
+
+      int cell_x = (int)((x - min_x) / cell_size);
+      int cell_y = (int)((y - min_y) / cell_size);
+      byte is_far_enough = 1;
+
+      /* A point within min_dist can be at most 2 cells away */
+      int n_x, n_y;
+      for (n_y = cell_y - 2; n_y <= cell_y + 2 && is_far_enough; n_y++) {
+        for (n_x = cell_x - 2; n_x <= cell_x + 2; n_x++) {
+          if (n_x < 0 || n_y < 0 || n_x >= (int)grid_x || n_y >= (int)grid_y) {
+            continue;
+          }
+
+          int other = grid[n_x + n_y * grid_x];
+          if (other == NO_POINT) {
+            continue;
+          }
+
+          float d_x = points_x[other] - x;
+          float d_y = points_y[other] - y;
+          if (d_x * d_x + d_y * d_y < min_dist2) {
+            is_far_enough = 0;
+            break;
+          }
+        }
+      }
+
+      if (!is_far_enough) {
+        continue;
+      }
+
+      points_x[point_count] = x;
+      points_y[point_count] = y;
+      grid[cell_x + cell_y * grid_x] = point_count;
+      active[active_count++] = point_count;
+      point_count += 1;
+      was_placed = 1;
+      break;
+    }
+
+    /* Out of attempts, nothing fits around this point anymore */
+    if (!was_placed) {
+      active[active_idx] = active[--active_count];
+    }
+  }
+
+  rewind_bump_allocator(scratch, mark);
+
+  return point_count;
+}
+
+/* Idle ticks before a chunk away from the player and lurkers is evicted */
+const uint CHUNK_EVICTION_TICKS = 120;
+/* Chunks kept resident around the player and every lurker, in chunks */
+const uint CHUNK_STREAM_RADIUS = 1;
+
+/* Fills the part of [x0, x1) x [y0, y1) inside the chunk with floor */
+void carve_chunk_floor(byte* tiles, uint origin_x, uint origin_y, uint x0,
+                       uint x1, uint y0, uint y1) {
+  /* Clipped to the chunk */
+  x0 = x0 > origin_x ? x0 - origin_x : 0;
+  y0 = y0 > origin_y ? y0 - origin_y : 0;
+  x1 = x1 > origin_x ? x1 - origin_x : 0;
+  y1 = y1 > origin_y ? y1 - origin_y : 0;
+  x1 = x1 > ARENA_CHUNK_SIDE ? ARENA_CHUNK_SIDE : x1;
+  y1 = y1 > ARENA_CHUNK_SIDE ? ARENA_CHUNK_SIDE : y1;
+
+  uint y;
+  for (y = y0; y < y1 && x0 < x1; y++) {
+    memset(tiles + x0 + y * ARENA_CHUNK_SIDE, FLOOR, x1 - x0);
+  }
+}
+
+/* Called with chunk_lock held */
+void generate_arena_chunk(Arena* arena, uint chunk_x, uint chunk_y) {
+  ArenaChunk* chunk = &arena->chunks[chunk_x + chunk_y * arena->chunks_x];
+  byte* tiles = malloc(ARENA_CHUNK_SIDE * ARENA_CHUNK_SIDE * sizeof(byte));
+  assert(tiles);
+  chunk->is_modified = 0;
+  chunk->is_mapped = 0;
+  chunk->last_used_tick = arena->stream_tick;
+  arena->resident_chunk_count += 1;
+
+  memset(tiles, WALL, ARENA_CHUNK_SIDE * ARENA_CHUNK_SIDE);
+
+  uint origin_x = chunk_x << ARENA_CHUNK_SHIFT;
+  uint origin_y = chunk_y << ARENA_CHUNK_SHIFT;
+  uint chunk_idx = chunk_x + chunk_y * arena->chunks_x;
+
+  uint i;
+  for (i = arena->chunk_room_start[chunk_idx];
+       i < arena->chunk_room_start[chunk_idx + 1]; i++) {
+    RoomSeed* seed = &arena->room_seeds[arena->chunk_rooms[i]];
+    carve_chunk_floor(tiles, origin_x, origin_y, seed->floor_x0,
+                      seed->floor_x1, seed->floor_y0, seed->floor_y1);
+  }
+
+  for (i = arena->chunk_doorway_start[chunk_idx];
+       i < arena->chunk_doorway_start[chunk_idx + 1]; i++) {
+    DoorwaySeed* door = &arena->doorways[arena->chunk_doorways[i]];
+    carve_chunk_floor(tiles, origin_x, origin_y, door->x0, door->x1, door->y0,
+                      door->y1);
+  }
+
+  if (arena->player_spawn_room != NO_ROOM) {
+    RoomSeed* seed = &arena->room_seeds[arena->player_spawn_room];
+    uint x = seed->center_x - origin_x;
+    uint y = seed->center_y - origin_y;
+    /* Unsigned, also out of range when left of or above the chunk */
+    if (x < ARENA_CHUNK_SIDE && y < ARENA_CHUNK_SIDE) {
+      tiles[x + y * ARENA_CHUNK_SIDE] = PLAYER_SPAWN;
+    }
+  }
+
+  /* Only published once filled, readers on other threads don't lock */
+  __atomic_store_n(&chunk->tiles, tiles, __ATOMIC_RELEASE);
+}
+
+byte* get_arena_chunk(Arena* arena, uint chunk_x, uint chunk_y) {
+  ArenaChunk* chunk = &arena->chunks[chunk_x + chunk_y * arena->chunks_x];
+  byte* tiles = __atomic_load_n(&chunk->tiles, __ATOMIC_ACQUIRE);
+  if (!tiles) {
+    pthread_mutex_lock(&arena->chunk_lock);
+    if (!chunk->tiles) {
+      generate_arena_chunk(arena, chunk_x, chunk_y);
+    }
+    tiles = chunk->tiles;
+    pthread_mutex_unlock(&arena->chunk_lock);
+  }
+  return tiles;
+}
+
+byte get_arena_tile(Arena* arena, uint x, uint y) {
+  byte* tiles =
+      get_arena_chunk(arena, x >> ARENA_CHUNK_SHIFT, y >> ARENA_CHUNK_SHIFT);
+  return tiles[(x & ARENA_CHUNK_MASK) +
+               (y & ARENA_CHUNK_MASK) * ARENA_CHUNK_SIDE];
+}
+
+void set_arena_tile(Arena* arena, uint x, uint y, byte tile) {
+  uint chunk_x = x >> ARENA_CHUNK_SHIFT;
+  uint chunk_y = y >> ARENA_CHUNK_SHIFT;
+  byte* tiles = get_arena_chunk(arena, chunk_x, chunk_y);
+  tiles[(x & ARENA_CHUNK_MASK) + (y & ARENA_CHUNK_MASK) * ARENA_CHUNK_SIDE] =
+      tile;
+  arena->chunks[chunk_x + chunk_y * arena->chunks_x].is_modified = 1;
+  arena->data_generation += 1;
+}
+
+void touch_chunks_around(Arena* arena, uint x, uint y) {
+  int center_x = x >> ARENA_CHUNK_SHIFT;
+  int center_y = y >> ARENA_CHUNK_SHIFT;
+  int r = CHUNK_STREAM_RADIUS;
+
+  int chunk_x, chunk_y;
+  for (chunk_y = center_y - r; chunk_y <= center_y + r; chunk_y++) {
+    for (chunk_x = center_x - r; chunk_x <= center_x + r; chunk_x++) {
+      if (chunk_x < 0 || chunk_y < 0 || chunk_x >= (int)arena->chunks_x ||
+          chunk_y >= (int)arena->chunks_y) {
+        continue;
+      }
+      get_arena_chunk(arena, chunk_x, chunk_y);
+      arena->chunks[chunk_x + chunk_y * arena->chunks_x].last_used_tick =
+          arena->stream_tick;
+    }
+  }
+}
+
+void stream_arena_chunks(Arena* arena) {
+  arena->stream_tick += 1;
+
+  touch_chunks_around(arena, arena->player->position_x,
+                      arena->player->position_y);
+
+  uint i;
+  for (i = 0; i < arena->lurkers.count; i++) {
+    touch_chunks_around(arena, (uint)arena->lurkers.position_x[i],
+                        (uint)arena->lurkers.position_y[i]);
+  }
+
+  uint chunk_count = arena->chunks_x * arena->chunks_y;
+  for (i = 0; i < chunk_count; i++) {
+    ArenaChunk* chunk = &arena->chunks[i];
+    if (chunk->tiles && !chunk->is_modified && !chunk->is_mapped &&
+        arena->stream_tick - chunk->last_used_tick > CHUNK_EVICTION_TICKS) {
+      free(chunk->tiles);
+      chunk->tiles = NULL;
+      arena->resident_chunk_count -= 1;
+    }
+  }
+}
+
+void clear_arena_chunks(Arena* arena) {
+  uint i;
+  for (i = 0; i < arena->chunks_x * arena->chunks_y; i++) {
+    if (!arena->chunks[i].is_mapped) {
+      free(arena->chunks[i].tiles);
+    }
+    arena->chunks[i].tiles = NULL;
+    arena->chunks[i].is_modified = 0;
+    arena->chunks[i].is_mapped = 0;
+  }
+  arena->resident_chunk_count = 0;
+  unmap_arena_file(arena);
+
+  /* Lurkers are level memory as well, they have to be spawned again */
+  free_lurker_storage(&arena->lurkers);
+  reset_bump_allocator(&arena->level_memory);
+  arena->room_seeds = NULL;
+  arena->chunk_room_start = NULL;
+  arena->chunk_rooms = NULL;
+  arena->doorways = NULL;
+  arena->doorway_count = 0;
+  arena->chunk_doorway_start = NULL;
+  arena->chunk_doorways = NULL;
+  arena->room_doorway_start = NULL;
+  arena->room_doorways = NULL;
+  arena->lurker_spawns = NULL;
+  arena->lurker_spawn_count = 0;
+  arena->player_spawn_room = NO_ROOM;
+}
+
+int compare_uint(const void* a, const void* b) {
+  uint lhs = *(const uint*)a;
+  uint rhs = *(const uint*)b;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+/* Same counting sort as build_seed_grid, but a rectangle can land in
+// several chunks. Rectangle i is the four uints x0, x1, y0, y1 found at
+// rects + i * stride bytes, empty ones land nowhere. The lists are level
+// memory.
+*/
+void bucket_rects_by_chunk(Arena* arena, byte* rects, uint stride,
+                           uint count, uint** start, uint** items) {
+  uint chunk_count = arena->chunks_x * arena->chunks_y;
+  *start = bump_calloc(&arena->level_memory, chunk_count + 1, sizeof(uint));
+  BumpMark mark = get_bump_mark(&arena->scratch_memory);
+
+  uint pass, i, chunk_x, chunk_y;
+  uint* fill = NULL;
+  for (pass = 0; pass < 2; pass++) {
+    for (i = 0; i < count; i++) {
+      uint* rect = (uint*)(rects + i * stride);
+      if (rect[0] >= rect[1] || rect[2] >= rect[3]) {
+        continue;
+      }
+
+      uint cx0 = rect[0] >> ARENA_CHUNK_SHIFT;
+      uint cx1 = (rect[1] - 1) >> ARENA_CHUNK_SHIFT;
+      uint cy0 = rect[2] >> ARENA_CHUNK_SHIFT;
+      uint cy1 = (rect[3] - 1) >> ARENA_CHUNK_SHIFT;
+
+      for (chunk_y = cy0; chunk_y <= cy1; chunk_y++) {
+        for (chunk_x = cx0; chunk_x <= cx1; chunk_x++) {
+          uint chunk = chunk_x + chunk_y * arena->chunks_x;
+          if (pass == 0) {
+            (*start)[chunk + 1] += 1;
+          } else {
+            (*items)[fill[chunk]++] = i;
+          }
+        }
+      }
+    }
+
+    if (pass == 0) {
+      for (i = 0; i < chunk_count; i++) {
+        (*start)[i + 1] += (*start)[i];
+      }
+      *items = bump_alloc(&arena->level_memory,
+                          ((*start)[chunk_count] + 1) * sizeof(uint));
+      fill = bump_alloc(&arena->scratch_memory, chunk_count * sizeof(uint));
+      memcpy(fill, *start, chunk_count * sizeof(uint));
+    }
+  }
+
+  rewind_bump_allocator(&arena->scratch_memory, mark);
+}
+
+void build_chunk_rooms(Arena* arena) {
+  bucket_rects_by_chunk(arena, (byte*)&arena->room_seeds[0].floor_x0,
+                        sizeof(RoomSeed), arena->room_seed_count,
+                        &arena->chunk_room_start, &arena->chunk_rooms);
+}
+
+void build_room_graph(Arena* arena) {
+  bucket_rects_by_chunk(arena, (byte*)&arena->doorways[0].x0,
+                        sizeof(DoorwaySeed), arena->doorway_count,
+                        &arena->chunk_doorway_start, &arena->chunk_doorways);
+
+  /* Every doorway is listed under both of its rooms */
+  uint room_count = arena->room_seed_count;
+  arena->room_doorway_start =
+      bump_calloc(&arena->level_memory, room_count + 1, sizeof(uint));
+  arena->room_doorways = bump_alloc(
+      &arena->level_memory, (arena->doorway_count * 2 + 1) * sizeof(uint));
+  BumpMark mark = get_bump_mark(&arena->scratch_memory);
+  uint* fill =
+      bump_alloc(&arena->scratch_memory, (room_count + 1) * sizeof(uint));
+
+  uint i;
+  for (i = 0; i < arena->doorway_count; i++) {
+    arena->room_doorway_start[arena->doorways[i].room_a + 1] += 1;
+    arena->room_doorway_start[arena->doorways[i].room_b + 1] += 1;
+  }
+  for (i = 0; i < room_count; i++) {
+    arena->room_doorway_start[i + 1] += arena->room_doorway_start[i];
+  }
+  memcpy(fill, arena->room_doorway_start, room_count * sizeof(uint));
+  for (i = 0; i < arena->doorway_count; i++) {
+    arena->room_doorways[fill[arena->doorways[i].room_a]++] = i;
+    arena->room_doorways[fill[arena->doorways[i].room_b]++] = i;
+  }
+
+  rewind_bump_allocator(&arena->scratch_memory, mark);
+}
+
+const uint NO_ROOM = (uint)-1;
+const uint NO_DOORWAY = (uint)-1;
+
+uint get_room_at(Arena* arena, uint x, uint y) {
+  uint chunk = (x >> ARENA_CHUNK_SHIFT) +
+               (y >> ARENA_CHUNK_SHIFT) * arena->chunks_x;
+  uint i;
+  for (i = arena->chunk_room_start[chunk];
+       i < arena->chunk_room_start[chunk + 1]; i++) {
+    RoomSeed* seed = &arena->room_seeds[arena->chunk_rooms[i]];
+    if (x >= seed->floor_x0 && x < seed->floor_x1 && y >= seed->floor_y0 &&
+        y < seed->floor_y1) {
+      return arena->chunk_rooms[i];
+    }
+  }
+  return NO_ROOM;
+}
+
+uint get_doorway_at(Arena* arena, uint x, uint y) {
+  uint chunk = (x >> ARENA_CHUNK_SHIFT) +
+               (y >> ARENA_CHUNK_SHIFT) * arena->chunks_x;
+  uint i;
+  for (i = arena->chunk_doorway_start[chunk];
+       i < arena->chunk_doorway_start[chunk + 1]; i++) {
+    DoorwaySeed* door = &arena->doorways[arena->chunk_doorways[i]];
+    if (x >= door->x0 && x < door->x1 && y >= door->y0 && y < door->y1) {
+      return arena->chunk_doorways[i];
+    }
+  }
+  return NO_DOORWAY;
+}
+
+/* Walls between rooms this thin or thinner get doorway candidates */
+const uint MAX_DOORWAY_LENGTH = 4;
+/* Doorways beyond the ones connecting all rooms, so that there are loops */
+const float EXTRA_DOORWAY_CHANCE = 0.2;
+
+/* Doorway candidate between two rooms facing each other across a thin
+// wall, placed at a random spot of the part where they face each other.
+*/
+byte find_doorway(Arena* arena, uint room_a, uint room_b, Rng* rng,
+                  DoorwaySeed* door) {
+  RoomSeed* a = &arena->room_seeds[room_a];
+  RoomSeed* b = &arena->room_seeds[room_b];
+  uint lo, hi, pos;
+
+  door->room_a = room_a;
+  door->room_b = room_b;
+
+  if (a->floor_x1 <= b->floor_x0 || b->floor_x1 <= a->floor_x0) {
+    /* Side by side, the corridor runs along x */
+    lo = a->floor_y0 > b->floor_y0 ? a->floor_y0 : b->floor_y0;
+    hi = a->floor_y1 < b->floor_y1 ? a->floor_y1 : b->floor_y1;
+    byte is_a_left = a->floor_x1 <= b->floor_x0;
+    uint x0 = is_a_left ? a->floor_x1 : b->floor_x1;
+    uint x1 = is_a_left ? b->floor_x0 : a->floor_x0;
+    if (lo >= hi || x1 - x0 > MAX_DOORWAY_LENGTH) {
+      return 0;
+    }
+
+    pos = rand_ui(rng, lo, hi);
+    door->x0 = x0;
+    door->x1 = x1;
+    door->y0 = pos;
+    door->y1 = pos + 1;
+    door->a_x = is_a_left ? x0 - 1 : x1;
+    door->b_x = is_a_left ? x1 : x0 - 1;
+    door->a_y = pos;
+    door->b_y = pos;
+    return 1;
+  }
+
+  if (a->floor_y1 <= b->floor_y0 || b->floor_y1 <= a->floor_y0) {
+    /* Above each other, the corridor runs along y */
+    lo = a->floor_x0 > b->floor_x0 ? a->floor_x0 : b->floor_x0;
+    hi = a->floor_x1 < b->floor_x1 ? a->floor_x1 : b->floor_x1;
+    byte is_a_below = a->floor_y1 <= b->floor_y0;
+    uint y0 = is_a_below ? a->floor_y1 : b->floor_y1;
+    uint y1 = is_a_below ? b->floor_y0 : a->floor_y0;
+    if (lo >= hi || y1 - y0 > MAX_DOORWAY_LENGTH) {
+      return 0;
+    }
+
+    pos = rand_ui(rng, lo, hi);
+    door->x0 = pos;
+    door->x1 = pos + 1;
+    door->y0 = y0;
+    door->y1 = y1;
+    door->a_x = pos;
+    door->b_x = pos;
+    door->a_y = is_a_below ? y0 - 1 : y1;
+    door->b_y = is_a_below ? y1 : y0 - 1;
+    return 1;
+  }
+
+  return 0;
+}
+
+/* Whether the corridor stays clear of every other room, including the
+// tiles right beside it, so it doesn't connect rooms it isn't meant to.
+*/
+byte is_doorway_clear(Arena* arena, DoorwaySeed* door) {
+  uint x0 = door->x0 > 0 ? door->x0 - 1 : 0;
+  uint y0 = door->y0 > 0 ? door->y0 - 1 : 0;
+  uint x1 = door->x1 + 1;
+  uint y1 = door->y1 + 1;
+
+  uint chunk_x, chunk_y, i;
+  for (chunk_y = y0 >> ARENA_CHUNK_SHIFT;
+       chunk_y <= (y1 - 1) >> ARENA_CHUNK_SHIFT && chunk_y < arena->chunks_y;
+       chunk_y++) {
+    for (chunk_x = x0 >> ARENA_CHUNK_SHIFT;
+         chunk_x <= (x1 - 1) >> ARENA_CHUNK_SHIFT &&
+         chunk_x < arena->chunks_x;
+         chunk_x++) {
+      uint chunk = chunk_x + chunk_y * arena->chunks_x;
+      for (i = arena->chunk_room_start[chunk];
+           i < arena->chunk_room_start[chunk + 1]; i++) {
+        uint room = arena->chunk_rooms[i];
+        RoomSeed* seed = &arena->room_seeds[room];
+        if (room != door->room_a && room != door->room_b &&
+            seed->floor_x0 < x1 && x0 < seed->floor_x1 &&
+            seed->floor_y0 < y1 && y0 < seed->floor_y1) {
+          return 0;
+        }
+      }
+    }
+  }
+  return 1;
+}
+
+/* Union-find root with path halving */
+uint find_room_set(uint* parents, uint room) {
+  while (parents[room] != room) {
+    parents[room] = parents[parents[room]];
+    room = parents[room];
+  }
+  return room;
+}
+
+/* Collects a doorway candidate for every pair of rooms facing each other,
+// then keeps a random spanning forest of them, Kruskal style, plus a few
+// extra ones for loops. Rooms touching without a wall in between always
+// keep theirs, they are connected either way.
+// Needs chunk_rooms, fills doorways.
+*/
+void place_doorways(Arena* arena, Rng* rng) {
+  BumpAllocator* scratch = &arena->scratch_memory;
+  BumpMark mark = get_bump_mark(scratch);
+  uint room_count = arena->room_seed_count;
+  uint candidate_capacity = room_count * 2 + 1;
+  uint candidate_count = 0;
+  DoorwaySeed* candidates =
+      bump_alloc(scratch, candidate_capacity * sizeof(DoorwaySeed));
+  /* Rooms span several chunks, this lists each neighbour once per room */
+  uint* last_paired = bump_alloc(scratch, (room_count + 1) * sizeof(uint));
+
+  uint i, j, item, chunk_x, chunk_y;
+  for (i = 0; i < room_count; i++) {
+    last_paired[i] = NO_ROOM;
+  }
+
+  for (i = 0; i < room_count; i++) {
+    RoomSeed* seed = &arena->room_seeds[i];
+    uint x0 = seed->floor_x0 > MAX_DOORWAY_LENGTH
+                  ? seed->floor_x0 - MAX_DOORWAY_LENGTH
+                  : 0;
+    uint y0 = seed->floor_y0 > MAX_DOORWAY_LENGTH
+                  ? seed->floor_y0 - MAX_DOORWAY_LENGTH
+                  : 0;
+    uint cx1 = (seed->floor_x1 + MAX_DOORWAY_LENGTH) >> ARENA_CHUNK_SHIFT;
+    uint cy1 = (seed->floor_y1 + MAX_DOORWAY_LENGTH) >> ARENA_CHUNK_SHIFT;
+    cx1 = cx1 < arena->chunks_x ? cx1 : arena->chunks_x - 1;
+    cy1 = cy1 < arena->chunks_y ? cy1 : arena->chunks_y - 1;
+
+    for (chunk_y = y0 >> ARENA_CHUNK_SHIFT; chunk_y <= cy1; chunk_y++) {
+      for (chunk_x = x0 >> ARENA_CHUNK_SHIFT; chunk_x <= cx1; chunk_x++) {
+        uint chunk = chunk_x + chunk_y * arena->chunks_x;
+        for (item = arena->chunk_room_start[chunk];
+             item < arena->chunk_room_start[chunk + 1]; item++) {
+          j = arena->chunk_rooms[item];
+          if (j <= i || last_paired[j] == i) {
+            continue;
+          }
+          last_paired[j] = i;
+
+          DoorwaySeed door;
+          if (!find_doorway(arena, i, j, rng, &door) ||
+              !is_doorway_clear(arena, &door)) {
+            continue;
+          }
+
+          /* Outgrown lists stay behind in scratch until the rewind */
+          if (candidate_count == candidate_capacity) {
+            DoorwaySeed* grown = bump_alloc(
+                scratch, candidate_capacity * 2 * sizeof(DoorwaySeed));
+            memcpy(grown, candidates,
+                   candidate_count * sizeof(DoorwaySeed));
+            candidates = grown;
+            candidate_capacity *= 2;
+          }
+          candidates[candidate_count++] = door;
+        }
+      }
+    }
+  }
+
+  /* Fisher-Yates, the spanning forest is picked in this order */
+  for (i = 0; i + 1 < candidate_count; i++) {
+    j = rand_ui(rng, i, candidate_count);
+    DoorwaySeed swap = candidates[i];
+    candidates[i] = candidates[j];
+    candidates[j] = swap;
+  }
+
+  uint* parents = last_paired;
+  for (i = 0; i < room_count; i++) {
+    parents[i] = i;
+  }
+
+  arena->doorway_count = 0;
+  for (i = 0; i < candidate_count; i++) {
+    DoorwaySeed* door = &candidates[i];
+    uint set_a = find_room_set(parents, door->room_a);
+    uint set_b = find_room_set(parents, door->room_b);
+    byte is_open = door->x0 == door->x1 || door->y0 == door->y1;
+
+    if (set_a != set_b) {
+      parents[set_a] = set_b;
+    } else if (!is_open && rand_f(rng, 0, 1) >= EXTRA_DOORWAY_CHANCE) {
+      continue;
+    }
+    candidates[arena->doorway_count++] = *door;
+  }
+
+  arena->doorways = bump_alloc(
+      &arena->level_memory, (arena->doorway_count + 1) * sizeof(DoorwaySeed));
+  memcpy(arena->doorways, candidates,
+         arena->doorway_count * sizeof(DoorwaySeed));
+
+  /* Group sizes, counted at the roots */
+  uint* group_sizes = bump_calloc(scratch, room_count + 1, sizeof(uint));
+  uint largest = 0;
+  for (i = 0; i < room_count; i++) {
+    uint set = find_room_set(parents, i);
+    group_sizes[set] += 1;
+    largest = group_sizes[set] > group_sizes[largest] ? set : largest;
+  }
+
+  for (i = 0; i < room_count; i++) {
+    arena->room_seeds[i].total_door_count = 0;
+  }
+  for (i = 0; i < arena->doorway_count; i++) {
+    arena->room_seeds[arena->doorways[i].room_a].total_door_count += 1;
+    arena->room_seeds[arena->doorways[i].room_b].total_door_count += 1;
+  }
+  for (i = 0; i < room_count; i++) {
+    RoomSeed* seed = &arena->room_seeds[i];
+    seed->is_reachable = find_room_set(parents, i) == largest;
+    seed->needs_more_doors = seed->total_door_count == 0;
+  }
+
+  rewind_bump_allocator(scratch, mark);
+}
+
+/* Random reachable room, needs place_doorways to have run */
+uint pick_player_spawn_room(Arena* arena, Rng* rng) {
+  uint reachable_count = 0;
+  uint i;
+  for (i = 0; i < arena->room_seed_count; i++) {
+    reachable_count += arena->room_seeds[i].is_reachable;
+  }
+  if (reachable_count == 0) {
+    return NO_ROOM;
+  }
+
+  uint pick = rand_ui(rng, 0, reachable_count);
+  for (i = 0; i < arena->room_seed_count; i++) {
+    if (arena->room_seeds[i].is_reachable && pick-- == 0) {
+      break;
+    }
+  }
+  arena->room_seeds[i].is_player_spawn = 1;
+  return i;
+}
+
+/* Blocks are allocated once and reused by every later level and frame */
+const unsigned long LEVEL_MEMORY_BLOCK_SIZE = 1 << 20;
+const unsigned long SCRATCH_MEMORY_BLOCK_SIZE = 1 << 20;
+
+byte is_arena_size_valid(uint size_x, uint size_y) {
+  return size_x >= MIN_ARENA_SIZE && size_x <= MAX_ARENA_SIZE &&
+         size_y >= MIN_ARENA_SIZE && size_y <= MAX_ARENA_SIZE;
+}
+
+void init_arena(Arena* arena, Player* player, uint size_x, uint size_y) {
+  assert(is_arena_size_valid(size_x, size_y));
+
   arena->player = player;
 
-  arena->lurker_count = 0;
-  arena->lurker_capacity = 16;
-  arena->lurkers = malloc(arena->lurker_capacity * sizeof(Lurker));
-  assert(arena->lurkers);
+  init_bump_allocator(&arena->level_memory, LEVEL_MEMORY_BLOCK_SIZE);
+  init_bump_allocator(&arena->scratch_memory, SCRATCH_MEMORY_BLOCK_SIZE);
+  init_lurker_storage(&arena->lurkers, &arena->level_memory);
 
-  arena->size_x = ARENA_SIZE;
-  arena->size_y = ARENA_SIZE;
-  arena->data = malloc(ARENA_SIZE * ARENA_SIZE * sizeof(uint));
-  assert(arena->data);
+  arena->size_x = size_x;
+  arena->size_y = size_y;
+  arena->chunks_x = (size_x + ARENA_CHUNK_MASK) >> ARENA_CHUNK_SHIFT;
+  arena->chunks_y = (size_y + ARENA_CHUNK_MASK) >> ARENA_CHUNK_SHIFT;
+  arena->chunks = calloc(arena->chunks_x * arena->chunks_y, sizeof(ArenaChunk));
+  assert(arena->chunks);
+  pthread_mutex_init(&arena->chunk_lock, NULL);
+  arena->resident_chunk_count = 0;
+  arena->stream_tick = 0;
+  arena->chunk_room_start = NULL;
+  arena->chunk_rooms = NULL;
+  arena->doorways = NULL;
+  arena->doorway_count = 0;
+  arena->chunk_doorway_start = NULL;
+  arena->chunk_doorways = NULL;
+  arena->room_doorway_start = NULL;
+  arena->room_doorways = NULL;
+  arena->lurker_spawns = NULL;
+  arena->lurker_spawn_count = 0;
+  arena->file_mapping = NULL;
+  arena->file_mapping_size = 0;
+  arena->data_generation = 0;
+
+  /* Tuned for 60x60, small arenas get proportionally smaller rooms and
+  // margins, so that there is still room for more than a couple of seeds.
+  */
+  uint min_side = size_x < size_y ? size_x : size_y;
+  arena->avg_room_side = min_side / 5 < AVG_ROOM_SIDE ? min_side / 5
+                                                       : AVG_ROOM_SIDE;
+  arena->edge_padding = min_side / 6 < 10 ? min_side / 6 : 10;
 
   uint total_v = arena->size_x * arena->size_y;
-  uint avg_room_v = AVG_ROOM_SIDE * AVG_ROOM_SIDE;
+  uint avg_room_v = arena->avg_room_side * arena->avg_room_side;
   float assumed_wall_ratio = 0.35;
   float seed_count_f = (float)total_v / avg_room_v * assumed_wall_ratio;
   /* This avoids roundf(), it is broken on my setup */
   uint seed_count = (uint)(seed_count_f + 0.5f);
 
+  /* Allocated by generate_arena or load_arena, as level memory */
+  arena->room_seed_target = seed_count;
   arena->room_seed_count = seed_count;
   arena->room_seeds_finished = 0;
-  arena->room_seeds = malloc(arena->room_seed_count * sizeof(RoomSeed));
-  assert(arena->room_seeds);
+  arena->room_seeds = NULL;
+  arena->player_spawn_room = NO_ROOM;
 }
 
-void generate_arena(Arena* arena) {
-  uint total_v = arena->size_x * arena->size_y;
-  uint edge_padding = 10;
+void free_arena(Arena* arena) {
+  clear_arena_chunks(arena);
+  free(arena->chunks);
+  pthread_mutex_destroy(&arena->chunk_lock);
+  free_bump_allocator(&arena->level_memory);
+  free_bump_allocator(&arena->scratch_memory);
+}
+
+ArenaGenerationStatus generate_arena(Arena* arena, uint seed) {
+  uint edge_padding = arena->edge_padding;
   uint max_usable_rng_x = arena->size_x - edge_padding;
   uint max_usable_rng_y = arena->size_y - edge_padding;
 
-  memset(arena->data, WALL, total_v * sizeof(uint));
+  Rng rng;
+  seed_rng(&rng, seed, ARENA_GENERATION_STREAM);
+
+  clear_arena_chunks(arena);
+  /* A previous generation may have fit fewer rooms */
+  arena->room_seed_count = arena->room_seed_target;
+  arena->room_seeds_finished = 0;
+  arena->room_seeds = bump_alloc(&arena->level_memory,
+                                 arena->room_seed_count * sizeof(RoomSeed));
+
+  /* Generation temporaries all go to scratch, released at the end */
+  BumpAllocator* scratch = &arena->scratch_memory;
+  BumpMark mark = get_bump_mark(scratch);
+
+  /* Seeds are spread with Poisson-disk sampling. The spacing is picked so
+  // a maximal packing of the usable area (~0.7 / min_dist^2 points per tile)
+  // has some headroom over the seed count, then a random subset is kept,
+  // which keeps the seeds spread over the whole map rather than clustered
+  // around the first sample.
+  */
+  const float SAMPLE_HEADROOM = 1.5;
+  float usable_v = (float)(max_usable_rng_x - edge_padding) *
+                   (max_usable_rng_y - edge_padding);
+  float min_seed_dist =
+      sqrt(0.7f * usable_v / (arena->room_seed_count * SAMPLE_HEADROOM));
+  min_seed_dist = min_seed_dist < 3 ? 3 : min_seed_dist;
+
+  uint max_samples = (uint)usable_v;
+  float* samples_x = bump_alloc(scratch, max_samples * sizeof(float));
+  float* samples_y = bump_alloc(scratch, max_samples * sizeof(float));
+
+  uint sample_count =
+      sample_poisson_disk(edge_padding, edge_padding, max_usable_rng_x,
+                          max_usable_rng_y, min_seed_dist, samples_x,
+                          samples_y, max_samples, &rng, scratch);
+
+  ArenaGenerationStatus status = ARENA_GENERATION_OK;
+  if (sample_count < arena->room_seed_count) {
+    arena->room_seed_count = sample_count;
+    status = ARENA_GENERATION_TOO_FEW_ROOMS;
+  }
+
+  /* x and y growth velocity of every seed */
+  float* growth_vels =
+      bump_alloc(scratch, (arena->room_seed_count * 2 + 1) * sizeof(float));
+  fill_rand_f(&rng, growth_vels, arena->room_seed_count * 2, .2, .5);
 
-  uint i, j, pos_x, pos_y;
+  uint i, pos_x, pos_y;
   for (i = 0; i < arena->room_seed_count; i++) {
-  retry_point_gen:
-    pos_x = rand_ui(edge_padding, max_usable_rng_x);
-    pos_y = rand_ui(edge_padding, max_usable_rng_y);
+    /* Partial Fisher-Yates shuffle, picks a sample not picked before */
+    uint pick = rand_ui(&rng, i, sample_count);
+    float picked_x = samples_x[pick];
+    float picked_y = samples_y[pick];
+    samples_x[pick] = samples_x[i];
+    samples_y[pick] = samples_y[i];
+    samples_x[i] = picked_x;
+    samples_y[i] = picked_y;
 
-    for (j = 0; j < i; j++) {
-      RoomSeed checked_seed = arena->room_seeds[j];
-      uint dist_x = abs((int)checked_seed.center_x - (int)pos_x);
-      uint dist_y = abs((int)checked_seed.center_y - (int)pos_y);
-      if (dist_x < 3 || dist_y < 3) {
-        goto retry_point_gen;
-      }
-    }
+    pos_x = (uint)picked_x;
+    pos_y = (uint)picked_y;
 
     RoomSeed new_seed;
 
@@ -90,8 +949,8 @@ void generate_arena(Arena* arena) {
     new_seed.center_x = pos_x;
     new_seed.center_y = pos_y;
 
-    new_seed.growth_vel_x = rand_f(.2, .5);
-    new_seed.growth_vel_y = rand_f(.2, .5);
+    new_seed.growth_vel_x = growth_vels[i * 2];
+    new_seed.growth_vel_y = growth_vels[i * 2 + 1];
 
     /* TODO: Go through all and set the ones on opposite edges */
     new_seed.is_player_spawn = 0;
@@ -108,6 +967,34 @@ void generate_arena(Arena* arena) {
     arena->room_seeds[i] = new_seed;
   }
 
+  /* Rooms are only tested against seeds close enough to matter, and only on
+  // steps where contact is actually possible. After each test, the clearance
+  // to the closest obstacle gives a lower bound on the number of steps until
+  // anything can touch, as neither room can close the gap faster than its
+  // growth velocity. Those steps just grow the room without any tests.
+  // This skips exactly the tests that would have failed anyway, so the
+  // result is the same as testing every pair on every step.
+  */
+  const float DIR_PAD = 1.5;
+  const float PAD = 1.1;
+  const float CLEARANCE_EPSILON = 0.05;
+  float horizon = arena->avg_room_side;
+  float max_radius = 1;
+  float max_growth_vel = 0;
+
+  for (i = 0; i < arena->room_seed_count; i++) {
+    RoomSeed* seed = &arena->room_seeds[i];
+    update_room_bounds(seed);
+    seed->unchecked_steps = 0;
+    max_growth_vel = seed->growth_vel_x > max_growth_vel ? seed->growth_vel_x
+                                                         : max_growth_vel;
+    max_growth_vel = seed->growth_vel_y > max_growth_vel ? seed->growth_vel_y
+                                                         : max_growth_vel;
+  }
+
+  SeedGrid grid;
+  build_seed_grid(&grid, arena, arena->avg_room_side);
+
   while (arena->room_seeds_finished < arena->room_seed_count) {
     for (i = 0; i < arena->room_seed_count; i++) {
       RoomSeed* seed = &arena->room_seeds[i];
@@ -116,54 +1003,122 @@ void generate_arena(Arena* arena) {
         continue;
       }
 
-      float dir_pad = 1.5;
-      float pad = 1.1;
+      if (seed->unchecked_steps > 0) {
+        seed->unchecked_steps -= 1;
+      } else {
+        /* Any seed centered outside of this window is at least horizon away */
+        float reach = DIR_PAD + max_radius + horizon;
+        uint cell_x0 = get_grid_cell(&grid, seed->bound_l - reach, grid.size_x);
+        uint cell_x1 = get_grid_cell(&grid, seed->bound_r + reach, grid.size_x);
+        uint cell_y0 = get_grid_cell(&grid, seed->bound_b - reach, grid.size_y);
+        uint cell_y1 = get_grid_cell(&grid, seed->bound_t + reach, grid.size_y);
 
-      uint j;
-      for (j = 0; j < arena->room_seed_count; j++) {
-        if (i == j) {
-          continue;
-        }
+        float clearance = horizon;
+        float c;
+        uint cell_x, cell_y, item;
+        for (cell_y = cell_y0; cell_y <= cell_y1; cell_y++) {
+          for (cell_x = cell_x0; cell_x <= cell_x1; cell_x++) {
+            uint cell = cell_x + cell_y * grid.size_x;
+            for (item = grid.cell_start[cell]; item < grid.cell_start[cell + 1];
+                 item++) {
+              uint j = grid.items[item];
+              if (i == j) {
+                continue;
+              }
 
-        RoomSeed* ck_seed = &arena->room_seeds[j];
+              RoomSeed* ck_seed = &arena->room_seeds[j];
 
-        /* Note: Could set block_* status for the ck_seed too, but currently
-        //       doing that doesn't skip any logic, so there is no point.
-        */
+              /* Note: Could set block_* status for the ck_seed too, but
+              //       doing that doesn't skip any logic, so there is no point.
+              */
 
-        if (are_rooms_overlapping(seed, ck_seed, dir_pad, pad, pad, pad)) {
-          seed->block_t = 1;
-        }
+              if (are_rooms_overlapping(arena, seed, ck_seed, DIR_PAD,
+                                        PAD, PAD, PAD)) {
+                seed->block_t = 1;
+              }
+
+              if (are_rooms_overlapping(arena, seed, ck_seed, PAD,
+                                        DIR_PAD, PAD, PAD)) {
+                seed->block_r = 1;
+              }
+
+              if (are_rooms_overlapping(arena, seed, ck_seed, PAD,
+                                        PAD, DIR_PAD, PAD)) {
+                seed->block_b = 1;
+              }
 
-        if (are_rooms_overlapping(seed, ck_seed, pad, dir_pad, pad, pad)) {
-          seed->block_r = 1;
+              if (are_rooms_overlapping(arena, seed, ck_seed, PAD,
+                                        PAD, PAD, DIR_PAD)) {
+                seed->block_l = 1;
+              }
+
+              /* Blocks are final, only the open directions can still change */
+              if (!seed->block_t) {
+                c = get_rooms_clearance(seed, ck_seed, DIR_PAD, PAD, PAD, PAD);
+                clearance = c < clearance ? c : clearance;
+              }
+              if (!seed->block_r) {
+                c = get_rooms_clearance(seed, ck_seed, PAD, DIR_PAD, PAD, PAD);
+                clearance = c < clearance ? c : clearance;
+              }
+              if (!seed->block_b) {
+                c = get_rooms_clearance(seed, ck_seed, PAD, PAD, DIR_PAD, PAD);
+                clearance = c < clearance ? c : clearance;
+              }
+              if (!seed->block_l) {
+                c = get_rooms_clearance(seed, ck_seed, PAD, PAD, PAD, DIR_PAD);
+                clearance = c < clearance ? c : clearance;
+              }
+            }
+          }
         }
 
-        if (are_rooms_overlapping(seed, ck_seed, pad, pad, dir_pad, pad)) {
-          seed->block_b = 1;
+        if (!seed->block_t) {
+          c = get_edge_clearance(arena, seed, DIR_PAD, PAD, PAD, PAD);
+          clearance = c < clearance ? c : clearance;
+        }
+        if (!seed->block_r) {
+          c = get_edge_clearance(arena, seed, PAD, DIR_PAD, PAD, PAD);
+          clearance = c < clearance ? c : clearance;
+        }
+        if (!seed->block_b) {
+          c = get_edge_clearance(arena, seed, PAD, PAD, DIR_PAD, PAD);
+          clearance = c < clearance ? c : clearance;
+        }
+        if (!seed->block_l) {
+          c = get_edge_clearance(arena, seed, PAD, PAD, PAD, DIR_PAD);
+          clearance = c < clearance ? c : clearance;
         }
 
-        if (are_rooms_overlapping(seed, ck_seed, pad, pad, pad, dir_pad)) {
-          seed->block_l = 1;
+        float closing_vel = max_growth_vel * 2;
+        if (clearance > CLEARANCE_EPSILON) {
+          seed->unchecked_steps =
+              (uint)((clearance - CLEARANCE_EPSILON) / closing_vel);
         }
       }
 
       if (!seed->block_t) {
         seed->radius_t += seed->growth_vel_y;
+        max_radius = seed->radius_t > max_radius ? seed->radius_t : max_radius;
       }
 
       if (!seed->block_b) {
         seed->radius_b += seed->growth_vel_y;
+        max_radius = seed->radius_b > max_radius ? seed->radius_b : max_radius;
       }
 
       if (!seed->block_l) {
         seed->radius_l += seed->growth_vel_x;
+        max_radius = seed->radius_l > max_radius ? seed->radius_l : max_radius;
       }
 
       if (!seed->block_r) {
         seed->radius_r += seed->growth_vel_x;
+        max_radius = seed->radius_r > max_radius ? seed->radius_r : max_radius;
       }
 
+      update_room_bounds(seed);
+
       if (seed->block_b && seed->block_t && seed->block_l && seed->block_r) {
         arena->room_seeds_finished += 1;
         seed->is_room_finished = 1;
@@ -171,36 +1126,65 @@ void generate_arena(Arena* arena) {
     }
   }
 
-  /* Keep iterating over all until all have req doorways.
-  // TODO: This algo.
-  */
+  rewind_bump_allocator(scratch, mark);
 
   for (i = 0; i < arena->room_seed_count; i++) {
-    RoomSeed seed = arena->room_seeds[i];
+    RoomSeed* seed = &arena->room_seeds[i];
+
+    float x_start_f = seed->center_x - seed->radius_l;
+    float x_end_f = seed->center_x + seed->radius_r;
+    float y_start_f = seed->center_y - seed->radius_b;
+    float y_end_f = seed->center_y + seed->radius_t;
+
+    seed->floor_x0 = (uint)(x_start_f + 1.f);
+    seed->floor_x1 = (uint)x_end_f;
+    seed->floor_y0 = (uint)(y_start_f + 1.f);
+    seed->floor_y1 = (uint)y_end_f + 1;
   }
 
-  for (i = 0; i < arena->room_seed_count; i++) {
-    RoomSeed seed = arena->room_seeds[i];
+  build_chunk_rooms(arena);
+  place_doorways(arena, &rng);
+  build_room_graph(arena);
 
-    float x_start_f = seed.center_x - seed.radius_l;
-    float x_end_f = seed.center_x + seed.radius_r;
-    float y_start_f = seed.center_y - seed.radius_b;
-    float y_end_f = seed.center_y + seed.radius_t;
+  /* Tiles aren't written here, chunks are generated from these on demand.
+  // The player starts in a room every other one can be reached from, all
+  // the other rooms get a lurker at their center.
+  */
+  arena->player_spawn_room = pick_player_spawn_room(arena, &rng);
+  arena->lurker_spawn_count = 0;
+  arena->lurker_spawns = bump_alloc(&arena->level_memory,
+                                    arena->room_seed_count * sizeof(uint));
+  for (i = 0; i < arena->room_seed_count; i++) {
+    RoomSeed* seed = &arena->room_seeds[i];
+    if (i != arena->player_spawn_room) {
+      arena->lurker_spawns[arena->lurker_spawn_count++] =
+          seed->center_x + seed->center_y * arena->size_x;
+    }
+  }
 
-    uint x_start = (uint)(x_start_f + 1.f);
-    uint x_end = (uint)x_end_f;
-    uint y_start = (uint)(y_start_f + 1.f);
-    uint y_end = (uint)y_end_f;
+  qsort(arena->lurker_spawns, arena->lurker_spawn_count, sizeof(uint),
+        compare_uint);
 
-    uint x_span = x_end - x_start;
+  /* The whole map changed, one bump covers every tile */
+  arena->data_generation += 1;
 
-    uint y;
-    for (y = y_start; y <= y_end; y++) {
-      uint offset = x_start + y * arena->size_x;
-      memset(arena->data + offset, FLOOR, x_span);
-    }
+  return status;
+}
 
-    uint lurker_spawn_idx = seed.center_x + seed.center_y * arena->size_x;
-    arena->data[lurker_spawn_idx] = LURKER_SPAWN;
+void spawn_player(Arena* arena) {
+  if (arena->player_spawn_room == NO_ROOM) {
+    return;
   }
+
+  RoomSeed* seed = &arena->room_seeds[arena->player_spawn_room];
+  arena->player->position_x = seed->center_x;
+  arena->player->position_y = seed->center_y;
+}
+
+ArenaGenerationStatus regenerate_level(Arena* arena, uint seed) {
+  /* Drops the old level itself, lurkers included */
+  ArenaGenerationStatus status = generate_arena(arena, seed);
+  init_lurkers(arena, seed);
+  spawn_player(arena);
+  return status;
 }
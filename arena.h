@@ -1,13 +1,16 @@
 #ifndef ARENA_H
 #define ARENA_H
 
+#include <pthread.h>
+
+#include "bump_allocator.h"
 #include "lurker.h"
 #include "player.h"
+#include "rng.h"
 #include "utils.h"
 
 /* FIXME: Split Arena into ArenaGenerationState and ArenaState */
 
-/* TODO: Tile as a struct with properties, not enum */
 enum ArenaTile {
   FLOOR = 0,
   FLOOR_MOSS,
@@ -23,45 +26,204 @@ enum ArenaTile {
   LURKER_SPAWN,
   SIDE_OBJECTIVE,
   END_OBJECTIVE,
+  ARENA_TILE_COUNT,
+};
+
+enum TileSpawn {
+  SPAWNS_NOTHING = 0,
+  SPAWNS_PLAYER,
+  SPAWNS_LURKER,
 };
 
+/* Everything the game needs to know about a tile type, look it up in
+// TILE_PROPERTIES instead of comparing against specific ArenaTile values.
+*/
+typedef struct {
+  char display_char;
+  char color_code;
+  byte is_walkable;
+  byte can_light_pass;
+  /* Whether generation may place spawns and objectives here */
+  byte is_spawnable;
+  /* What init_lurkers and co. create on this tile */
+  byte spawns;
+} TileProperties;
+
+extern const TileProperties TILE_PROPERTIES[ARENA_TILE_COUNT];
+
 typedef struct {
   uint center_x, center_y;
   float growth_vel_x, growth_vel_y;
   uint total_door_count;
   float radius_l, radius_r, radius_t, radius_b;
+  /* Cached edges (center +- radius), see update_room_bounds */
+  float bound_l, bound_r, bound_t, bound_b;
+  /* Growth steps left before collisions have to be tested again */
+  uint unchecked_steps;
+  /* Final floor area, [x0, x1) x [y0, y1), what chunks get generated from */
+  uint floor_x0, floor_x1, floor_y0, floor_y1;
   byte block_l, block_r, block_t, block_b;
   byte is_player_spawn;
   byte is_end_objective_room;
   byte is_room_finished;
-  /* For connectivity (doors) verification logic
-  // TODO: TBD
-  */
+  /* Connected to the largest group of rooms through doorways */
   byte is_reachable;
+  /* No doorway could be placed, the room is isolated */
   byte needs_more_doors;
 } RoomSeed;
 
+/* A straight, 1 tile wide corridor through the wall between two rooms
+// facing each other. Doorways are the edges of the room graph.
+*/
 typedef struct {
-  /* Not implementing >1 doors per room for now;
-  // uint room_a_id, room_b_id;
-  */
-  float a_x, a_y, b_x, b_y;
+  uint room_a, room_b;
+  /* Carved floor, [x0, x1) x [y0, y1), empty when the rooms touch */
+  uint x0, x1, y0, y1;
+  /* Floor tiles of room_a / room_b right at either end of the corridor */
+  uint a_x, a_y, b_x, b_y;
 } DoorwaySeed;
 
+enum {
+  ARENA_CHUNK_SHIFT = 5,
+  ARENA_CHUNK_SIDE = 1 << ARENA_CHUNK_SHIFT,
+  ARENA_CHUNK_MASK = ARENA_CHUNK_SIDE - 1,
+};
+
+typedef struct {
+  /* NULL while the chunk isn't resident */
+  byte* tiles;
+  uint last_used_tick;
+  /* Edited since generation, can't be regenerated so it's never evicted */
+  byte is_modified;
+  /* Tiles point into Arena.file_mapping, see load_arena. The OS pages these
+  // in and out on its own, so they are never evicted either.
+  */
+  byte is_mapped;
+} ArenaChunk;
+
+typedef enum {
+  ARENA_GENERATION_OK = 0,
+  ARENA_GENERATION_TOO_FEW_ROOMS,
+} ArenaGenerationStatus;
+
 typedef struct {
   uint size_x, size_y;
-  byte* data;
+  /* Tiles are stored in ARENA_CHUNK_SIDE^2 chunks, only generated from the
+  // room layout once accessed, and evicted again when idle for a while.
+  // Always go through get_arena_tile / set_arena_tile / get_arena_chunk.
+  */
+  ArenaChunk* chunks;
+  uint chunks_x, chunks_y;
+  /* Held while generating a chunk, which may happen from job threads */
+  pthread_mutex_t chunk_lock;
+  /* Generated chunks in memory, mapped chunks aren't counted */
+  uint resident_chunk_count;
+  uint stream_tick;
+  /* Rooms overlapping each chunk, chunk c has the rooms
+  // chunk_rooms[chunk_room_start[c]] .. chunk_rooms[chunk_room_start[c + 1]]
+  */
+  uint* chunk_room_start;
+  uint* chunk_rooms;
+  DoorwaySeed* doorways;
+  uint doorway_count;
+  /* Same as chunk_rooms, for doorway corridors */
+  uint* chunk_doorway_start;
+  uint* chunk_doorways;
+  /* Room graph, room r connects through the doorways room_doorways[
+  // room_doorway_start[r]] .. room_doorways[room_doorway_start[r + 1]]
+  */
+  uint* room_doorway_start;
+  uint* room_doorways;
+  /* Tile indices (x + y * size_x), in ascending order */
+  uint* lurker_spawns;
+  uint lurker_spawn_count;
+  /* Loaded arena file backing the mapped chunks, NULL if generated */
+  void* file_mapping;
+  unsigned long file_mapping_size;
+  /* Everything that lives as long as the level does, the room layout
+  // and lurkers. Dropped at once by clear_arena_chunks. Chunk tiles aren't
+  // in here, they are evicted one by one while streaming.
+  */
+  BumpAllocator level_memory;
+  /* Temporaries of the main thread. Functions rewind what they allocate,
+  // except for buffers that last until the end of the frame, the game loop
+  // resets it after every frame.
+  */
+  BumpAllocator scratch_memory;
+  /* Bumped on every tile change, lets caches detect map changes */
+  uint data_generation;
   Player* player;
-  Lurker* lurkers;
-  uint lurker_count;
-  uint lurker_capacity;
+  Lurkers lurkers;
   RoomSeed* room_seeds;
   uint room_seed_count;
+  /* Rooms generate_arena tries to fit, room_seed_count may end up lower */
+  uint room_seed_target;
+  /* Room with the PLAYER_SPAWN tile at its center, NO_ROOM if none */
+  uint player_spawn_room;
   uint room_seeds_finished;
+  /* Generation parameters, derived from the arena size in init_arena */
+  uint avg_room_side;
+  uint edge_padding;
 } Arena;
 
-void init_arena(Arena* arena, Player* player);
+byte is_arena_size_valid(uint size_x, uint size_y);
+
+void init_arena(Arena* arena, Player* player, uint size_x, uint size_y);
+void free_arena(Arena* arena);
+
+byte get_arena_tile(Arena* arena, uint x, uint y);
+void set_arena_tile(Arena* arena, uint x, uint y, byte tile);
+
+/* Tiles of a chunk, row-major with a stride of ARENA_CHUNK_SIDE.
+// Generates the chunk if it isn't resident. Reading tiles is safe from job
+// threads, everything that modifies the arena is not.
+*/
+byte* get_arena_chunk(Arena* arena, uint chunk_x, uint chunk_y);
+
+/* Keeps chunks around the player and lurkers resident, evicts unmodified
+// chunks that haven't been near either for a while. Call once per tick.
+*/
+void stream_arena_chunks(Arena* arena);
+
+/* Drops every chunk, the room layout they are generated from, and lurkers */
+void clear_arena_chunks(Arena* arena);
+
+/* Rebuilds the per-chunk room lists from the rooms' floor rectangles */
+void build_chunk_rooms(Arena* arena);
+
+/* Rebuilds the room graph and per-chunk doorway lists from the doorways */
+void build_room_graph(Arena* arena);
+
+extern const uint NO_ROOM;
+extern const uint NO_DOORWAY;
+
+/* Room whose floor holds the tile, NO_ROOM for walls and corridors */
+uint get_room_at(Arena* arena, uint x, uint y);
+/* Doorway whose corridor holds the tile, or NO_DOORWAY */
+uint get_doorway_at(Arena* arena, uint x, uint y);
+
+
+/* Rng stream ids derived from a run's seed, see seed_rng.
+// Lurker n uses LURKER_STREAM_BASE + n.
+*/
+enum {
+  ARENA_GENERATION_STREAM = 0,
+  LURKER_STREAM_BASE,
+};
+
+/* Generation always produces a playable map, a non-OK status means it is
+// degraded, e.g. fewer rooms than requested fit into the arena.
+// The same seed and arena size always give the same map.
+*/
+ArenaGenerationStatus generate_arena(Arena* arena, uint seed);
+
+/* Moves the player onto the PLAYER_SPAWN tile, if the level has one */
+void spawn_player(Arena* arena);
 
-void generate_arena(Arena* arena);
+/* Replaces the level with a new one generated from seed, lurkers and the
+// player included. The arena keeps its size, so the chunk table and every
+// block of level and scratch memory are reused, as are canvases drawing it.
+*/
+ArenaGenerationStatus regenerate_level(Arena* arena, uint seed);
 
 #endif
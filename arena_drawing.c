@@ -1,53 +1,77 @@
 #include "arena_drawing.h"
 
-#include "colors.h"
+#include <string.h>
 
-void draw_arena(Canvas* canvas, Arena* arena) {
-  int x, y;
-  for (y = 0; y < arena->size_x; y++) {
-    for (x = 0; x < arena->size_x; x++) {
-      uint element = arena->data[x + y * arena->size_x];
-      char repr = '?';
-      byte can_light_pass = 0;
-      byte color_code = FLOOR_COLOR_CODE;
-
-      switch (element) {
-        case FLOOR:
-          repr = ' ';
-          can_light_pass = 1;
-          break;
-        case WALL:
-          repr = '#';
-          color_code = WALL_COLOR_CODE;
-          break;
-        case PLAYER_SPAWN:
-          repr = 'P';
-          can_light_pass = 1;
-          break;
-        case LURKER_SPAWN:
-          repr = 'E';
-          can_light_pass = 1;
-          break;
-        case SIDE_OBJECTIVE:
-          repr = '$';
-          color_code = SIDE_GOAL_COLOR_CODE;
-          break;
-        case END_OBJECTIVE:
-          repr = '%';
-          color_code = EXIT_COLOR_CODE;
-          break;
-      }
+/* Renders the map itself into the canvas' static layer, chunk by chunk.
+// Only the part of the chunk in view is rendered.
+*/
+void bake_arena_chunk(Canvas* canvas, Arena* arena, uint chunk_x,
+                      uint chunk_y) {
+  byte* tiles = get_arena_chunk(arena, chunk_x, chunk_y);
+  uint origin_x = chunk_x << ARENA_CHUNK_SHIFT;
+  uint origin_y = chunk_y << ARENA_CHUNK_SHIFT;
+  uint min_x, min_y, max_x, max_y;
+  get_canvas_bounds(canvas, &min_x, &min_y, &max_x, &max_y);
+  uint begin_x = origin_x > min_x ? origin_x : min_x;
+  uint begin_y = origin_y > min_y ? origin_y : min_y;
+  uint end_x = origin_x + ARENA_CHUNK_SIDE;
+  uint end_y = origin_y + ARENA_CHUNK_SIDE;
+  end_x = end_x > max_x ? max_x : end_x;
+  end_y = end_y > max_y ? max_y : end_y;
+
+  uint x, y;
+  for (y = begin_y; y < end_y; y++) {
+    byte* row = tiles + (y - origin_y) * ARENA_CHUNK_SIDE - origin_x;
+    for (x = begin_x; x < end_x; x++) {
+      const TileProperties* props = &TILE_PROPERTIES[row[x]];
+
+      CanvasTile tile;
+      tile.display_char = props->display_char;
+      tile.can_light_pass = props->can_light_pass;
+      tile.color_code = props->color_code;
 
-      uint c_pos = x * canvas->scale_x + y * canvas->scale_y * canvas->size_x;
+      uint c_pos = get_canvas_index(canvas, x, y);
 
       /* TODO: Same for y */
       uint x_off;
       for (x_off = 0; x_off < canvas->scale_x; x_off++) {
-        canvas->data[c_pos + x_off].display_char = repr;
-        canvas->data[c_pos + x_off].can_light_pass = can_light_pass;
-        canvas->data[c_pos + x_off].color_code = color_code;
+        canvas->static_data[c_pos + x_off] = tile;
       }
     }
   }
 }
 
+void bake_arena_layer(Canvas* canvas, Arena* arena) {
+  uint min_x, min_y, max_x, max_y;
+  get_canvas_bounds(canvas, &min_x, &min_y, &max_x, &max_y);
+
+  uint chunk_x, chunk_y;
+  for (chunk_y = min_y >> ARENA_CHUNK_SHIFT;
+       chunk_y <= (max_y - 1) >> ARENA_CHUNK_SHIFT; chunk_y++) {
+    for (chunk_x = min_x >> ARENA_CHUNK_SHIFT;
+         chunk_x <= (max_x - 1) >> ARENA_CHUNK_SHIFT; chunk_x++) {
+      bake_arena_chunk(canvas, arena, chunk_x, chunk_y);
+    }
+  }
+
+  canvas->static_generation = arena->data_generation;
+  canvas->static_offset_x = canvas->view.offset_x;
+  canvas->static_offset_y = canvas->view.offset_y;
+  canvas->is_static_layer_valid = 1;
+}
+
+/* The map is static between modifications, so it is only rendered again
+// when Arena.data_generation changes or the view moves. Every frame starts
+// as a copy of it, dynamic entities are drawn on top afterwards.
+*/
+void draw_arena(Canvas* canvas, Arena* arena) {
+  if (!canvas->is_static_layer_valid ||
+      canvas->static_generation != arena->data_generation ||
+      canvas->static_offset_x != canvas->view.offset_x ||
+      canvas->static_offset_y != canvas->view.offset_y) {
+    bake_arena_layer(canvas, arena);
+  }
+
+  memcpy(canvas->data, canvas->static_data,
+         canvas->size_x * canvas->size_y * sizeof(CanvasTile));
+}
@@ -0,0 +1,371 @@
+/* mmap() and friends are POSIX, hidden by -ansi unless requested explicitly */
+#define _POSIX_C_SOURCE 200112L
+
+#include "arena_file.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "bump_allocator.h"
+#include "utils.h"
+
+/* File layout, every section starts at an ARENA_FILE_ALIGNMENT boundary:
+//   ArenaFileHeader
+//   tiles, chunks_x * chunks_y chunks in row-major chunk order, each one
+//     ARENA_CHUNK_SIDE^2 tiles laid out exactly like ArenaChunk.tiles
+//   ArenaFileRoom[room_seed_count]
+//   DoorwaySeed[doorway_count], same as Arena.doorways
+//   uint[lurker_spawn_count], same as Arena.lurker_spawns
+// Bump ARENA_FILE_VERSION on any change to the layout or the records.
+*/
+
+const char ARENA_FILE_MAGIC[4] = {'S', 'G', 'A', 'R'};
+const uint ARENA_FILE_VERSION = 2;
+const uint ARENA_FILE_ALIGNMENT = 64;
+
+typedef struct {
+  char magic[4];
+  uint version;
+  uint header_size;
+  uint size_x, size_y;
+  uint chunk_side;
+  uint chunks_x, chunks_y;
+  uint room_seed_count;
+  uint doorway_count;
+  uint lurker_spawn_count;
+  uint tiles_offset;
+  uint rooms_offset;
+  uint doorways_offset;
+  uint lurker_spawns_offset;
+  uint file_size;
+} ArenaFileHeader;
+
+/* The parts of RoomSeed that outlive generation */
+typedef struct {
+  uint center_x, center_y;
+  float radius_l, radius_r, radius_t, radius_b;
+  uint floor_x0, floor_x1, floor_y0, floor_y1;
+  byte is_player_spawn;
+  byte is_end_objective_room;
+  byte is_reachable;
+  byte needs_more_doors;
+} ArenaFileRoom;
+
+const char* describe_arena_file_status(ArenaFileStatus status) {
+  switch (status) {
+    case ARENA_FILE_OK:
+      return "ok";
+    case ARENA_FILE_CANT_OPEN:
+      return "can't open the file";
+    case ARENA_FILE_CANT_WRITE:
+      return "can't write the file";
+    case ARENA_FILE_NOT_AN_ARENA:
+      return "not an arena file";
+    case ARENA_FILE_UNSUPPORTED_VERSION:
+      return "arena file version not supported";
+    case ARENA_FILE_CORRUPTED:
+      return "arena file is corrupted";
+  }
+  return "unknown error";
+}
+
+uint align_file_offset(uint offset) {
+  return (offset + ARENA_FILE_ALIGNMENT - 1) / ARENA_FILE_ALIGNMENT *
+         ARENA_FILE_ALIGNMENT;
+}
+
+/* Offsets and size for the given contents, shared by save and load so they
+// can't disagree on the layout.
+*/
+void layout_arena_file(ArenaFileHeader* header) {
+  uint chunk_bytes = ARENA_CHUNK_SIDE * ARENA_CHUNK_SIDE;
+  header->header_size = sizeof(ArenaFileHeader);
+  header->tiles_offset = align_file_offset(sizeof(ArenaFileHeader));
+  header->rooms_offset = align_file_offset(
+      header->tiles_offset + header->chunks_x * header->chunks_y * chunk_bytes);
+  header->doorways_offset = align_file_offset(
+      header->rooms_offset + header->room_seed_count * sizeof(ArenaFileRoom));
+  header->lurker_spawns_offset = align_file_offset(
+      header->doorways_offset + header->doorway_count * sizeof(DoorwaySeed));
+  header->file_size =
+      header->lurker_spawns_offset + header->lurker_spawn_count * sizeof(uint);
+}
+
+byte write_file_padding(FILE* file, uint offset) {
+  const char ZEROES[64] = {0};
+  long position = ftell(file);
+  return position >= 0 && position <= (long)offset &&
+         fwrite(ZEROES, 1, offset - position, file) == offset - position;
+}
+
+ArenaFileStatus save_arena(Arena* arena, const char* path) {
+  ArenaFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, ARENA_FILE_MAGIC, sizeof(header.magic));
+  header.version = ARENA_FILE_VERSION;
+  header.size_x = arena->size_x;
+  header.size_y = arena->size_y;
+  header.chunk_side = ARENA_CHUNK_SIDE;
+  header.chunks_x = arena->chunks_x;
+  header.chunks_y = arena->chunks_y;
+  header.room_seed_count = arena->room_seed_count;
+  header.doorway_count = arena->doorway_count;
+  header.lurker_spawn_count = arena->lurker_spawn_count;
+  layout_arena_file(&header);
+
+  FILE* file = fopen(path, "wb");
+  if (!file) {
+    return ARENA_FILE_CANT_OPEN;
+  }
+
+  byte is_ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+               write_file_padding(file, header.tiles_offset);
+
+  /* Chunks that aren't resident get generated, they are evicted again by
+  // the next stream_arena_chunks calls.
+  */
+  uint chunk_x, chunk_y;
+  for (chunk_y = 0; chunk_y < arena->chunks_y && is_ok; chunk_y++) {
+    for (chunk_x = 0; chunk_x < arena->chunks_x && is_ok; chunk_x++) {
+      byte* tiles = get_arena_chunk(arena, chunk_x, chunk_y);
+      is_ok = fwrite(tiles, ARENA_CHUNK_SIDE * ARENA_CHUNK_SIDE, 1, file) == 1;
+    }
+  }
+
+  is_ok = is_ok && write_file_padding(file, header.rooms_offset);
+
+  uint i;
+  for (i = 0; i < arena->room_seed_count && is_ok; i++) {
+    RoomSeed* seed = &arena->room_seeds[i];
+    ArenaFileRoom room;
+    memset(&room, 0, sizeof(room));
+    room.center_x = seed->center_x;
+    room.center_y = seed->center_y;
+    room.radius_l = seed->radius_l;
+    room.radius_r = seed->radius_r;
+    room.radius_t = seed->radius_t;
+    room.radius_b = seed->radius_b;
+    room.floor_x0 = seed->floor_x0;
+    room.floor_x1 = seed->floor_x1;
+    room.floor_y0 = seed->floor_y0;
+    room.floor_y1 = seed->floor_y1;
+    room.is_player_spawn = seed->is_player_spawn;
+    room.is_end_objective_room = seed->is_end_objective_room;
+    room.is_reachable = seed->is_reachable;
+    room.needs_more_doors = seed->needs_more_doors;
+    is_ok = fwrite(&room, sizeof(room), 1, file) == 1;
+  }
+
+  is_ok = is_ok && write_file_padding(file, header.doorways_offset) &&
+          fwrite(arena->doorways, sizeof(DoorwaySeed), arena->doorway_count,
+                 file) == arena->doorway_count;
+
+  is_ok = is_ok && write_file_padding(file, header.lurker_spawns_offset) &&
+          fwrite(arena->lurker_spawns, sizeof(uint), arena->lurker_spawn_count,
+                 file) == arena->lurker_spawn_count;
+
+  if (fclose(file) != 0) {
+    is_ok = 0;
+  }
+
+  return is_ok ? ARENA_FILE_OK : ARENA_FILE_CANT_WRITE;
+}
+
+/* Everything load_arena relies on besides the tiles themselves. Tile values
+// aren't checked, that would mean reading the whole file up front.
+*/
+ArenaFileStatus validate_arena_file(byte* data, unsigned long size) {
+  ArenaFileHeader* header = (ArenaFileHeader*)data;
+
+  if (size < sizeof(ArenaFileHeader) ||
+      memcmp(header->magic, ARENA_FILE_MAGIC, sizeof(header->magic)) != 0) {
+    return ARENA_FILE_NOT_AN_ARENA;
+  }
+
+  if (header->version != ARENA_FILE_VERSION ||
+      header->header_size != sizeof(ArenaFileHeader) ||
+      header->chunk_side != ARENA_CHUNK_SIDE) {
+    return ARENA_FILE_UNSUPPORTED_VERSION;
+  }
+
+  uint tile_count = header->size_x * header->size_y;
+  if (!is_arena_size_valid(header->size_x, header->size_y) ||
+      header->chunks_x !=
+          (header->size_x + ARENA_CHUNK_MASK) >> ARENA_CHUNK_SHIFT ||
+      header->chunks_y !=
+          (header->size_y + ARENA_CHUNK_MASK) >> ARENA_CHUNK_SHIFT ||
+      header->room_seed_count > tile_count ||
+      header->doorway_count > tile_count ||
+      header->lurker_spawn_count > tile_count) {
+    return ARENA_FILE_CORRUPTED;
+  }
+
+  ArenaFileHeader expected = *header;
+  layout_arena_file(&expected);
+  if (memcmp(&expected, header, sizeof(ArenaFileHeader)) != 0 ||
+      header->file_size != size) {
+    return ARENA_FILE_CORRUPTED;
+  }
+
+  ArenaFileRoom* rooms = (ArenaFileRoom*)(data + header->rooms_offset);
+  uint i;
+  for (i = 0; i < header->room_seed_count; i++) {
+    ArenaFileRoom* room = &rooms[i];
+    if (room->floor_x0 >= room->floor_x1 || room->floor_x1 > header->size_x ||
+        room->floor_y0 >= room->floor_y1 || room->floor_y1 > header->size_y) {
+      return ARENA_FILE_CORRUPTED;
+    }
+    /* The player is put on the center, it has to be floor */
+    if (room->is_player_spawn &&
+        (room->center_x < room->floor_x0 || room->center_x >= room->floor_x1 ||
+         room->center_y < room->floor_y0 || room->center_y >= room->floor_y1)) {
+      return ARENA_FILE_CORRUPTED;
+    }
+  }
+
+  DoorwaySeed* doors = (DoorwaySeed*)(data + header->doorways_offset);
+  for (i = 0; i < header->doorway_count; i++) {
+    DoorwaySeed* door = &doors[i];
+    if (door->room_a >= header->room_seed_count ||
+        door->room_b >= header->room_seed_count ||
+        door->x0 > door->x1 || door->x1 > header->size_x ||
+        door->y0 > door->y1 || door->y1 > header->size_y ||
+        door->a_x >= header->size_x || door->a_y >= header->size_y ||
+        door->b_x >= header->size_x || door->b_y >= header->size_y) {
+      return ARENA_FILE_CORRUPTED;
+    }
+  }
+
+  uint* spawns = (uint*)(data + header->lurker_spawns_offset);
+  for (i = 0; i < header->lurker_spawn_count; i++) {
+    if (spawns[i] >= tile_count) {
+      return ARENA_FILE_CORRUPTED;
+    }
+  }
+
+  return ARENA_FILE_OK;
+}
+
+ArenaFileStatus load_arena(Arena* arena, Player* player, const char* path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return ARENA_FILE_CANT_OPEN;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    close(fd);
+    return ARENA_FILE_CANT_OPEN;
+  }
+
+  /* mmap refuses empty files, there is nothing to load from those anyway */
+  if ((unsigned long)file_stat.st_size < sizeof(ArenaFileHeader)) {
+    close(fd);
+    return ARENA_FILE_NOT_AN_ARENA;
+  }
+
+  /* Private and writable, set_arena_tile on a mapped chunk gets a
+  // copy-on-write page instead of changing the file.
+  */
+  unsigned long size = (unsigned long)file_stat.st_size;
+  void* mapping =
+      mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return ARENA_FILE_CANT_OPEN;
+  }
+
+  byte* data = mapping;
+  ArenaFileStatus status = validate_arena_file(data, size);
+  if (status != ARENA_FILE_OK) {
+    munmap(mapping, size);
+    return status;
+  }
+
+  ArenaFileHeader* header = (ArenaFileHeader*)data;
+  init_arena(arena, player, header->size_x, header->size_y);
+  arena->file_mapping = mapping;
+  arena->file_mapping_size = size;
+
+  uint chunk_bytes = ARENA_CHUNK_SIDE * ARENA_CHUNK_SIDE;
+  uint i;
+  for (i = 0; i < arena->chunks_x * arena->chunks_y; i++) {
+    arena->chunks[i].tiles = data + header->tiles_offset + i * chunk_bytes;
+    arena->chunks[i].is_mapped = 1;
+  }
+
+  arena->room_seed_count = header->room_seed_count;
+  arena->room_seeds_finished = header->room_seed_count;
+  arena->room_seeds =
+      bump_alloc(&arena->level_memory,
+                 (arena->room_seed_count + 1) * sizeof(RoomSeed));
+
+  ArenaFileRoom* rooms = (ArenaFileRoom*)(data + header->rooms_offset);
+  for (i = 0; i < arena->room_seed_count; i++) {
+    RoomSeed* seed = &arena->room_seeds[i];
+    ArenaFileRoom* room = &rooms[i];
+    memset(seed, 0, sizeof(RoomSeed));
+    seed->center_x = room->center_x;
+    seed->center_y = room->center_y;
+    seed->radius_l = room->radius_l;
+    seed->radius_r = room->radius_r;
+    seed->radius_t = room->radius_t;
+    seed->radius_b = room->radius_b;
+    seed->bound_l = seed->center_x - seed->radius_l;
+    seed->bound_r = seed->center_x + seed->radius_r;
+    seed->bound_t = seed->center_y + seed->radius_t;
+    seed->bound_b = seed->center_y - seed->radius_b;
+    seed->floor_x0 = room->floor_x0;
+    seed->floor_x1 = room->floor_x1;
+    seed->floor_y0 = room->floor_y0;
+    seed->floor_y1 = room->floor_y1;
+    seed->block_l = seed->block_r = seed->block_t = seed->block_b = 1;
+    seed->is_player_spawn = room->is_player_spawn;
+    if (seed->is_player_spawn) {
+      arena->player_spawn_room = i;
+    }
+    seed->is_end_objective_room = room->is_end_objective_room;
+    seed->is_reachable = room->is_reachable;
+    seed->needs_more_doors = room->needs_more_doors;
+    seed->is_room_finished = 1;
+  }
+
+  arena->doorway_count = header->doorway_count;
+  arena->doorways =
+      bump_alloc(&arena->level_memory,
+                 (arena->doorway_count + 1) * sizeof(DoorwaySeed));
+  memcpy(arena->doorways, data + header->doorways_offset,
+         arena->doorway_count * sizeof(DoorwaySeed));
+
+  for (i = 0; i < arena->doorway_count; i++) {
+    arena->room_seeds[arena->doorways[i].room_a].total_door_count += 1;
+    arena->room_seeds[arena->doorways[i].room_b].total_door_count += 1;
+  }
+
+  arena->lurker_spawn_count = header->lurker_spawn_count;
+  arena->lurker_spawns =
+      bump_alloc(&arena->level_memory,
+                 (arena->lurker_spawn_count + 1) * sizeof(uint));
+  memcpy(arena->lurker_spawns, data + header->lurker_spawns_offset,
+         arena->lurker_spawn_count * sizeof(uint));
+
+  build_chunk_rooms(arena);
+  build_room_graph(arena);
+  arena->data_generation += 1;
+
+  return ARENA_FILE_OK;
+}
+
+void unmap_arena_file(Arena* arena) {
+  if (arena->file_mapping) {
+    munmap(arena->file_mapping, arena->file_mapping_size);
+    arena->file_mapping = NULL;
+    arena->file_mapping_size = 0;
+  }
+}
@@ -0,0 +1,37 @@
+#ifndef ARENA_FILE_H
+#define ARENA_FILE_H
+
+#include "arena.h"
+#include "player.h"
+#include "utils.h"
+
+/* Generated arenas can be saved to disk and loaded back instead of running
+// generate_arena. The file is laid out so that loading is a single mmap,
+// chunk tiles point straight into the mapping and are only paged in once
+// something touches them. Numbers are stored in host byte order, files
+// aren't meant to move between architectures.
+*/
+
+typedef enum {
+  ARENA_FILE_OK = 0,
+  ARENA_FILE_CANT_OPEN,
+  ARENA_FILE_CANT_WRITE,
+  ARENA_FILE_NOT_AN_ARENA,
+  ARENA_FILE_UNSUPPORTED_VERSION,
+  ARENA_FILE_CORRUPTED,
+} ArenaFileStatus;
+
+const char* describe_arena_file_status(ArenaFileStatus status);
+
+/* Writes every tile, including ones modified since generation */
+ArenaFileStatus save_arena(Arena* arena, const char* path);
+
+/* Replaces init_arena + generate_arena. On failure arena is left untouched,
+// on success it is freed with free_arena as usual.
+*/
+ArenaFileStatus load_arena(Arena* arena, Player* player, const char* path);
+
+/* Used by clear_arena_chunks, releases the mapping made by load_arena */
+void unmap_arena_file(Arena* arena);
+
+#endif
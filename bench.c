@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "arena_drawing.h"
+#include "arena_file.h"
+#include "canvas.h"
+#include "lurker_drawing.h"
+#include "lurker_logic.h"
+#include "player.h"
+#include "jobs.h"
+#include "player_drawing.h"
+#include "rays.h"
+#include "timing.h"
+
+/* Headless benchmark harness, built with `make bench`.
+// Runs the same pipeline as the game loop in main.c for a fixed number of
+// fixed-timestep ticks, without ncurses, and reports per-stage timings.
+// The final Canvas checksum changes whenever simulation or drawing output
+// does, compare it between runs to catch unintended behaviour changes.
+//
+// Usage:
+// ./bench [-l load_file] [-s save_file] [-j threads] [ticks] [seed] [width]
+//         [height]
+// With -l the arena comes from the file and seed only drives the simulation.
+// Threads default to the number of CPUs, results don't depend on them.
+*/
+
+const uint DEFAULT_BENCH_TICKS = 1000;
+const uint DEFAULT_BENCH_SEED = 1;
+/* View of a typical terminal, 200 columns by 50 rows */
+const uint BENCH_VIEW_SIZE_X = 100;
+const uint BENCH_VIEW_SIZE_Y = 50;
+
+enum BenchStage {
+  STAGE_STREAM_CHUNKS = 0,
+  STAGE_UPDATE_LURKERS,
+  STAGE_DRAW_ARENA,
+  STAGE_DRAW_PLAYER,
+  STAGE_DRAW_LURKER_RAYS,
+  STAGE_DRAW_LURKERS,
+  STAGE_TOTAL,
+  STAGE_COUNT,
+};
+
+const char* STAGE_NAMES[STAGE_COUNT] = {
+    "stream_chunks",    "update_lurkers", "draw_arena", "draw_player",
+    "draw_lurker_rays", "draw_lurkers",   "total",
+};
+
+int compare_ns(const void* a, const void* b) {
+  unsigned long lhs = *(const unsigned long*)a;
+  unsigned long rhs = *(const unsigned long*)b;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+/* FNV-1a over every visible property of every tile */
+unsigned long checksum_canvas(Canvas* canvas) {
+  unsigned long hash = 2166136261UL;
+  uint i, tilecount = canvas->size_x * canvas->size_y;
+  for (i = 0; i < tilecount; i++) {
+    CanvasTile* tile = &canvas->data[i];
+    hash = ((hash ^ (byte)tile->display_char) * 16777619UL) & 0xffffffffUL;
+    hash = ((hash ^ (byte)tile->color_code) * 16777619UL) & 0xffffffffUL;
+    hash = ((hash ^ tile->can_light_pass) * 16777619UL) & 0xffffffffUL;
+  }
+  return hash;
+}
+
+void report_stage(const char* name, unsigned long* samples, uint count) {
+  qsort(samples, count, sizeof(unsigned long), compare_ns);
+  uint p99_idx = (uint)((count - 1) * 0.99f);
+  printf("%-18s %12lu %12lu %12lu\n", name, samples[0], samples[count / 2],
+         samples[p99_idx]);
+}
+
+int main(int argc, char** argv) {
+  uint ticks = DEFAULT_BENCH_TICKS;
+  uint seed = DEFAULT_BENCH_SEED;
+  uint arena_size_x = DEFAULT_ARENA_SIZE;
+  uint arena_size_y = DEFAULT_ARENA_SIZE;
+  const char* load_path = NULL;
+  const char* save_path = NULL;
+  uint thread_count = get_cpu_count();
+
+  int arg = 1;
+  while (arg + 1 < argc && argv[arg][0] == '-') {
+    if (strcmp(argv[arg], "-l") == 0) {
+      load_path = argv[arg + 1];
+    } else if (strcmp(argv[arg], "-s") == 0) {
+      save_path = argv[arg + 1];
+    } else if (strcmp(argv[arg], "-j") == 0) {
+      thread_count = (uint)strtoul(argv[arg + 1], NULL, 10);
+    } else {
+      break;
+    }
+    arg += 2;
+  }
+
+  if (argc > arg) {
+    ticks = (uint)strtoul(argv[arg], NULL, 10);
+  }
+
+  if (argc > arg + 1) {
+    seed = (uint)strtoul(argv[arg + 1], NULL, 10);
+  }
+
+  if (argc > arg + 2) {
+    arena_size_x = (uint)strtoul(argv[arg + 2], NULL, 10);
+    arena_size_y = arena_size_x;
+  }
+
+  if (argc > arg + 3) {
+    arena_size_y = (uint)strtoul(argv[arg + 3], NULL, 10);
+  }
+
+  if (ticks == 0 || thread_count == 0 ||
+      !is_arena_size_valid(arena_size_x, arena_size_y)) {
+    fprintf(stderr,
+            "usage: %s [-l load_file] [-s save_file] [-j threads] [ticks] "
+            "[seed] [width] [height]\n",
+            argv[0]);
+    fprintf(stderr, "arena sides have to be between %u and %u\n",
+            MIN_ARENA_SIZE, MAX_ARENA_SIZE);
+    return 1;
+  }
+
+  Arena arena;
+  Player player = {10, 10};
+  Canvas canvas;
+
+  ArenaGenerationStatus gen_status = ARENA_GENERATION_OK;
+  ArenaFileStatus file_status;
+
+  unsigned long gen_start = now_ns();
+  if (load_path) {
+    file_status = load_arena(&arena, &player, load_path);
+    if (file_status != ARENA_FILE_OK) {
+      fprintf(stderr, "couldn't load %s: %s\n", load_path,
+              describe_arena_file_status(file_status));
+      return 1;
+    }
+  } else {
+    init_arena(&arena, &player, arena_size_x, arena_size_y);
+    gen_status = generate_arena(&arena, seed);
+  }
+  spawn_player(&arena);
+  init_canvas(&canvas, &arena, BENCH_VIEW_SIZE_X, BENCH_VIEW_SIZE_Y);
+  center_view(&canvas.view, &arena, player.position_x, player.position_y);
+  init_lurkers(&arena, seed);
+  unsigned long gen_ns = now_ns() - gen_start;
+
+  if (save_path) {
+    file_status = save_arena(&arena, save_path);
+    if (file_status != ARENA_FILE_OK) {
+      fprintf(stderr, "couldn't save %s: %s\n", save_path,
+              describe_arena_file_status(file_status));
+      return 1;
+    }
+  }
+
+  if (gen_status != ARENA_GENERATION_OK) {
+    fprintf(stderr, "warning: only %u rooms fit into the arena\n",
+            arena.room_seed_count);
+  }
+
+  JobSystem jobs;
+  init_job_system(&jobs, thread_count);
+
+  const float time_step = 1.0f / SIMULATION_HZ;
+
+  unsigned long* samples[STAGE_COUNT];
+  uint stage;
+  for (stage = 0; stage < STAGE_COUNT; stage++) {
+    samples[stage] = malloc(ticks * sizeof(unsigned long));
+    if (!samples[stage]) {
+      fprintf(stderr, "out of memory\n");
+      return 1;
+    }
+  }
+
+  uint tick;
+  for (tick = 0; tick < ticks; tick++) {
+    unsigned long t[STAGE_TOTAL + 1];
+
+    t[0] = now_ns();
+    stream_arena_chunks(&arena);
+    t[1] = now_ns();
+    update_lurkers(&arena, time_step, &jobs);
+    t[2] = now_ns();
+    draw_arena(&canvas, &arena);
+    t[3] = now_ns();
+    draw_player(&canvas, &arena);
+    t[4] = now_ns();
+    draw_lurker_rays(&canvas, &arena, &jobs);
+    t[5] = now_ns();
+    draw_lurkers(&canvas, &arena.lurkers, time_step);
+    t[6] = now_ns();
+    reset_bump_allocator(&arena.scratch_memory);
+
+    for (stage = 0; stage < STAGE_TOTAL; stage++) {
+      samples[stage][tick] = t[stage + 1] - t[stage];
+    }
+    samples[STAGE_TOTAL][tick] = t[STAGE_TOTAL] - t[0];
+  }
+
+  printf("arena: %ux%u, lurkers: %u, seed: %u, ticks: %u, threads: %u\n",
+         arena.size_x, arena.size_y, arena.lurkers.count, seed, ticks,
+         thread_count);
+  printf("%s: %lu ns\n\n", load_path ? "loading" : "generation", gen_ns);
+  printf("%-18s %12s %12s %12s\n", "stage (ns/tick)", "min", "median", "p99");
+
+  for (stage = 0; stage < STAGE_COUNT; stage++) {
+    report_stage(STAGE_NAMES[stage], samples[stage], ticks);
+    free(samples[stage]);
+  }
+
+  printf("\nresident chunks: %u / %u\n", arena.resident_chunk_count,
+         arena.chunks_x * arena.chunks_y);
+  printf("canvas checksum: %08lx\n", checksum_canvas(&canvas));
+
+  free_job_system(&jobs);
+  free_arena(&arena);
+  free_canvas(&canvas);
+
+  return 0;
+}
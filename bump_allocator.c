@@ -0,0 +1,104 @@
+#include "bump_allocator.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+/* Enough for any basic type, blocks start at a multiple of it too */
+const unsigned long BUMP_ALIGNMENT = 16;
+
+void init_bump_allocator(BumpAllocator* allocator, unsigned long block_size) {
+  allocator->first = NULL;
+  allocator->current = NULL;
+  allocator->used = 0;
+  allocator->block_size = block_size;
+}
+
+void free_bump_allocator(BumpAllocator* allocator) {
+  BumpBlock* block = allocator->first;
+  while (block) {
+    BumpBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+  init_bump_allocator(allocator, allocator->block_size);
+}
+
+unsigned long align_bump_size(unsigned long size) {
+  return (size + BUMP_ALIGNMENT - 1) & ~(BUMP_ALIGNMENT - 1);
+}
+
+/* The header is padded so data starts aligned */
+byte* get_block_data(BumpBlock* block) {
+  return (byte*)block + align_bump_size(sizeof(BumpBlock));
+}
+
+BumpBlock* create_bump_block(unsigned long size) {
+  BumpBlock* block = malloc(align_bump_size(sizeof(BumpBlock)) + size);
+  assert(block);
+  block->next = NULL;
+  block->size = size;
+  return block;
+}
+
+void* bump_alloc(BumpAllocator* allocator, unsigned long size) {
+  size = align_bump_size(size);
+
+  BumpBlock* block = allocator->current;
+  if (block && allocator->used + size <= block->size) {
+    void* data = get_block_data(block) + allocator->used;
+    allocator->used += size;
+    return data;
+  }
+
+  /* Blocks kept from before a reset are reused, ones too small for this
+  // are skipped until the next reset.
+  */
+  BumpBlock* previous = block;
+  block = block ? block->next : allocator->first;
+  while (block && block->size < size) {
+    previous = block;
+    block = block->next;
+  }
+
+  if (!block) {
+    block = create_bump_block(size > allocator->block_size
+                                  ? size
+                                  : allocator->block_size);
+    if (previous) {
+      previous->next = block;
+    } else {
+      allocator->first = block;
+    }
+  }
+
+  allocator->current = block;
+  allocator->used = size;
+  return get_block_data(block);
+}
+
+void* bump_calloc(BumpAllocator* allocator, unsigned long count,
+                  unsigned long size) {
+  void* data = bump_alloc(allocator, count * size);
+  memset(data, 0, count * size);
+  return data;
+}
+
+void reset_bump_allocator(BumpAllocator* allocator) {
+  allocator->current = NULL;
+  allocator->used = 0;
+}
+
+BumpMark get_bump_mark(BumpAllocator* allocator) {
+  BumpMark mark;
+  mark.block = allocator->current;
+  mark.used = allocator->used;
+  return mark;
+}
+
+void rewind_bump_allocator(BumpAllocator* allocator, BumpMark mark) {
+  allocator->current = mark.block;
+  allocator->used = mark.used;
+}
@@ -0,0 +1,48 @@
+#ifndef BUMP_ALLOCATOR_H
+#define BUMP_ALLOCATOR_H
+
+#include "utils.h"
+
+/* Linear allocator for memory that dies all at once. Allocating bumps an
+// offset, nothing is freed individually, reset_bump_allocator drops
+// everything in O(1). Memory comes in blocks that are kept across resets,
+// so once warmed up, allocating never reaches malloc.
+// Not thread safe, every allocator has a single owning thread.
+*/
+
+typedef struct BumpBlock {
+  struct BumpBlock* next;
+  unsigned long size;
+} BumpBlock;
+
+typedef struct {
+  BumpBlock* first;
+  BumpBlock* current;
+  /* Bytes used of current */
+  unsigned long used;
+  /* Size of new blocks, bigger allocations get a block of their own */
+  unsigned long block_size;
+} BumpAllocator;
+
+/* Position to rewind_bump_allocator back to */
+typedef struct {
+  BumpBlock* block;
+  unsigned long used;
+} BumpMark;
+
+void init_bump_allocator(BumpAllocator* allocator, unsigned long block_size);
+/* Returns every block to malloc */
+void free_bump_allocator(BumpAllocator* allocator);
+
+/* Aligned for any type, never NULL */
+void* bump_alloc(BumpAllocator* allocator, unsigned long size);
+void* bump_calloc(BumpAllocator* allocator, unsigned long count,
+                  unsigned long size);
+
+void reset_bump_allocator(BumpAllocator* allocator);
+
+/* Scratch use, take a mark, allocate temporaries, rewind to it once done */
+BumpMark get_bump_mark(BumpAllocator* allocator);
+void rewind_bump_allocator(BumpAllocator* allocator, BumpMark mark);
+
+#endif
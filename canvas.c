@@ -1,13 +1,14 @@
 #include "canvas.h"
 
-#include <ncurses.h>
 #include <stdlib.h>
 
 #include "colors.h"
 
-void init_canvas(Canvas* canvas, Arena* arena) {
-  canvas->size_x = arena->size_x * 2;
-  canvas->size_y = arena->size_y;
+void init_canvas(Canvas* canvas, Arena* arena, uint view_size_x,
+                 uint view_size_y) {
+  init_view(&canvas->view, arena, view_size_x, view_size_y);
+  canvas->size_x = canvas->view.size_x * 2;
+  canvas->size_y = canvas->view.size_y;
   canvas->scale_x = 2.0;
   canvas->scale_y = 1.0;
 
@@ -15,15 +16,13 @@ void init_canvas(Canvas* canvas, Arena* arena) {
   canvas->enable_coloring = 1;
   canvas->enable_fog_of_war = 0;
 
-  uint max_round_err = 2;
-  uint tilecount = (uint)(canvas->size_x * canvas->scale_x * canvas->size_y *
-                          canvas->scale_y);
+  uint tilecount = canvas->size_x * canvas->size_y;
 
-  canvas->data = malloc((tilecount + max_round_err) * sizeof(CanvasTile));
+  canvas->data = malloc(tilecount * sizeof(CanvasTile));
 
   /* FIXME: This is redundant, only useful for debugging */
   uint x, y, pos;
-  for (y = 0; y < canvas->size_x; y++) {
+  for (y = 0; y < canvas->size_y; y++) {
     for (x = 0; x < canvas->size_x; x++) {
       pos = x + y * canvas->size_x;
       canvas->data[pos].can_light_pass = 0;
@@ -31,17 +30,51 @@ void init_canvas(Canvas* canvas, Arena* arena) {
       canvas->data[pos].display_char = '?';
     }
   }
-}
 
-void print_canvas(Canvas* canvas) {
-  int x, y;
+  canvas->static_data = malloc(tilecount * sizeof(CanvasTile));
+  canvas->static_generation = 0;
+  canvas->static_offset_x = 0;
+  canvas->static_offset_y = 0;
+  canvas->is_static_layer_valid = 0;
+
+  /* Nothing is on screen yet, every tile has to be printed the first time */
+  canvas->printed_data = malloc(tilecount * sizeof(CanvasTile));
   for (y = 0; y < canvas->size_y; y++) {
-    move(y, 0);
-    for (x = 0; x < canvas->size_x; x++) {
-      CanvasTile* tile = &canvas->data[x + y * canvas->size_x];
-      attron(COLOR_PAIR(tile->color_code));
-      addch(tile->display_char);
-    }
+    invalidate_canvas_row(canvas, y);
+  }
+}
+
+void free_canvas(Canvas* canvas) {
+  free(canvas->data);
+  free(canvas->static_data);
+  free(canvas->printed_data);
+}
+
+void invalidate_canvas_row(Canvas* canvas, uint y) {
+  if (y >= canvas->size_y) {
+    return;
+  }
+
+  /* '\0' is never drawn, so no tile will compare equal to these */
+  CanvasTile* printed_row = &canvas->printed_data[y * canvas->size_x];
+  uint x;
+  for (x = 0; x < canvas->size_x; x++) {
+    printed_row[x].display_char = '\0';
   }
-};
+}
+
+uint get_canvas_index(Canvas* canvas, uint x, uint y) {
+  x -= canvas->view.offset_x;
+  y -= canvas->view.offset_y;
+  /* Integer math, float indices lose precision past 2^24 tiles */
+  return (uint)(x * canvas->scale_x) +
+         (uint)(y * canvas->scale_y) * canvas->size_x;
+}
 
+void get_canvas_bounds(Canvas* canvas, uint* min_x, uint* min_y, uint* max_x,
+                       uint* max_y) {
+  *min_x = canvas->view.offset_x;
+  *min_y = canvas->view.offset_y;
+  *max_x = canvas->view.offset_x + canvas->view.size_x;
+  *max_y = canvas->view.offset_y + canvas->view.size_y;
+}
@@ -3,6 +3,7 @@
 
 #include "arena.h"
 #include "utils.h"
+#include "view.h"
 
 typedef struct {
   byte can_light_pass;
@@ -10,15 +11,42 @@ typedef struct {
   char display_char;
 } CanvasTile;
 
+/* Rendered frame of the arena tiles within view, everything drawn onto it
+// has to be clipped to the view first, get_canvas_index doesn't check.
+*/
 typedef struct {
+  View view;
   uint size_x, size_y;
   float scale_x, scale_y;
   byte enable_fog_of_war;
   byte enable_coloring;
   CanvasTile* data;
+  /* Pre-rendered map under the view, see draw_arena */
+  CanvasTile* static_data;
+  uint static_generation;
+  uint static_offset_x, static_offset_y;
+  byte is_static_layer_valid;
+  /* What print_canvas last sent to the terminal, used to only emit changes */
+  CanvasTile* printed_data;
 } Canvas;
 
-void init_canvas(Canvas* canvas, Arena* arena);
-void print_canvas(Canvas* canvas);
+/* The view size is in arena tiles, the canvas is scaled up from it */
+void init_canvas(Canvas* canvas, Arena* arena, uint view_size_x,
+                 uint view_size_y);
+void free_canvas(Canvas* canvas);
+
+/* For anything drawn over the canvas outside of print_canvas (debug text),
+// makes the next print_canvas repaint the whole row.
+*/
+void invalidate_canvas_row(Canvas* canvas, uint y);
+
+/* Index of the first canvas tile covering the arena tile (x, y), which has
+// to be in view.
+*/
+uint get_canvas_index(Canvas* canvas, uint x, uint y);
+
+/* Arena tiles in view, min_x <= x < max_x, same for y */
+void get_canvas_bounds(Canvas* canvas, uint* min_x, uint* min_y, uint* max_x,
+                       uint* max_y);
 
 #endif
@@ -0,0 +1,44 @@
+#include "canvas_printing.h"
+
+#include <ncurses.h>
+
+byte are_tiles_equal(CanvasTile* a, CanvasTile* b) {
+  return a->display_char == b->display_char && a->color_code == b->color_code;
+}
+
+/* Only tiles that differ from what's already on screen are emitted.
+// Consecutive changed tiles sharing a color are sent as one run, so a frame
+// costs a move + attron + addnstr per run instead of attron + addch per tile.
+*/
+void print_canvas(Canvas* canvas) {
+  char run[256];
+  uint x, y;
+  for (y = 0; y < canvas->size_y; y++) {
+    CanvasTile* row = &canvas->data[y * canvas->size_x];
+    CanvasTile* printed_row = &canvas->printed_data[y * canvas->size_x];
+
+    x = 0;
+    while (x < canvas->size_x) {
+      if (are_tiles_equal(&row[x], &printed_row[x])) {
+        x++;
+        continue;
+      }
+
+      uint run_start = x;
+      uint run_length = 0;
+      char color_code = row[x].color_code;
+
+      while (x < canvas->size_x && run_length < sizeof(run) &&
+             row[x].color_code == color_code &&
+             !are_tiles_equal(&row[x], &printed_row[x])) {
+        run[run_length++] = row[x].display_char;
+        printed_row[x] = row[x];
+        x++;
+      }
+
+      move(y, run_start);
+      attron(COLOR_PAIR(color_code));
+      addnstr(run, run_length);
+    }
+  }
+};
@@ -0,0 +1,9 @@
+#ifndef CANVAS_PRINTING_H
+#define CANVAS_PRINTING_H
+
+#include "canvas.h"
+
+/* Only this module talks to ncurses, canvas.c stays terminal-agnostic */
+void print_canvas(Canvas* canvas);
+
+#endif
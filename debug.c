@@ -2,40 +2,133 @@
 
 #include <ncurses.h>
 
+#include "canvas.h"
 #include "colors.h"
 #include "lurker.h"
+#include "lurker_logic.h"
 #include "player.h"
+#include "profiler.h"
 #include "utils.h"
 
-void print_fps(float time_delta) {
+void print_fps(Canvas* canvas, float time_delta) {
   uint hz = 1 / time_delta;
+  invalidate_canvas_row(canvas, 0);
   move(0, 1);
   attron(COLOR_PAIR(TEXT_COLOR_CODE));
   printw("fps: %d", hz);
 }
 
-void print_frame_number() {
+void print_frame_number(Canvas* canvas) {
   static uint frame_number = 0;
+  invalidate_canvas_row(canvas, 0);
   move(0, 12);
   attron(COLOR_PAIR(TEXT_COLOR_CODE));
   printw("frame: %d", frame_number);
   frame_number = (frame_number + 1) % 9999;
 }
 
-void print_player_data(Player* player) {
-  move(player->position_y - 1, player->position_x * 2 + 2);
+void print_player_data(Canvas* canvas, Player* player) {
+  if (!is_tile_in_view(&canvas->view, player->position_x,
+                       player->position_y)) {
+    return;
+  }
+
+  uint pos = get_canvas_index(canvas, player->position_x, player->position_y);
+  uint row = pos / canvas->size_x;
+  invalidate_canvas_row(canvas, row - 1);
+  move(row - 1, pos % canvas->size_x + 2);
   attron(COLOR_PAIR(TEXT_COLOR_CODE));
   printw("x: %d y: %d", player->position_x, player->position_y);
 }
 
-void print_lurker_data(Lurker* lurkers, uint lurker_count) {
-  uint i;
-  for (i = 0; i < lurker_count; i++) {
-    Lurker lurker = lurkers[i];
-    move(lurker.position_y - 1, lurker.position_x * 2 + 1);
+void print_lurker_data(Canvas* canvas, Lurkers* lurkers) {
+  uint i, min_x, min_y, max_x, max_y;
+  get_canvas_bounds(canvas, &min_x, &min_y, &max_x, &max_y);
+  uint count = find_lurkers_in_rect(lurkers, min_x, min_y, max_x, max_y,
+                                    lurkers->query_results, lurkers->count);
+  uint k;
+  for (k = 0; k < count; k++) {
+    i = lurkers->query_results[k];
+    float pos_x = lurkers->position_x[i];
+    float pos_y = lurkers->position_y[i];
+    uint pos = get_canvas_index(canvas, pos_x, pos_y);
+    uint row = pos / canvas->size_x;
+    invalidate_canvas_row(canvas, row - 1);
+    move(row - 1, pos % canvas->size_x + 1);
     attron(COLOR_PAIR(TEXT_COLOR_CODE));
-    printw("x: %u y: %u, r_t: %f, r_c: %f", (uint)lurker.position_x,
-           (uint)lurker.position_y, lurker.azimuth_target_rad,
-           lurker.azimuth_current_rad);
+    printw("x: %u y: %u, r_t: %f, r_c: %f", (uint)pos_x, (uint)pos_y,
+           lurkers->azimuth_target_rad[i], lurkers->azimuth_current_rad[i]);
+  }
+}
+
+void print_level_data(Canvas* canvas, uint seed,
+                      unsigned long regeneration_ns) {
+  invalidate_canvas_row(canvas, 0);
+  move(0, 26);
+  attron(COLOR_PAIR(TEXT_COLOR_CODE));
+  printw("seed: %u", seed);
+  if (regeneration_ns) {
+    printw("  regenerated in %.3f ms", regeneration_ns / 1e6);
+  }
+}
+
+/* One row per stage with the avg and max of the kept frames, then a
+// sparkline of the most recent ones, scaled to the stage's own max.
+*/
+void print_profile_row(Profiler* profiler, uint row, const char* name,
+                       uint stage) {
+  /* Frames in the sparkline, and its levels from idle to the max */
+  const uint SPARKLINE_LENGTH = 48;
+  const char SPARKLINE_LEVELS[] = " .:-=+*#%@";
+  const uint LEVEL_COUNT = sizeof(SPARKLINE_LEVELS) - 2;
+
+  uint count = get_profiled_frame_count(profiler);
+  unsigned long sum_ns = 0;
+  unsigned long max_ns = 0;
+  uint age;
+  for (age = 0; age < count; age++) {
+    ProfileFrame* frame = get_profiled_frame(profiler, age);
+    unsigned long ns =
+        stage < PROFILE_STAGE_COUNT ? frame->stage_ns[stage] : frame->total_ns;
+    sum_ns += ns;
+    max_ns = ns > max_ns ? ns : max_ns;
+  }
+
+  char sparkline[64];
+  uint length = count < SPARKLINE_LENGTH ? count : SPARKLINE_LENGTH;
+  uint i;
+  for (i = 0; i < length; i++) {
+    /* Oldest on the left */
+    ProfileFrame* frame = get_profiled_frame(profiler, length - 1 - i);
+    unsigned long ns =
+        stage < PROFILE_STAGE_COUNT ? frame->stage_ns[stage] : frame->total_ns;
+    sparkline[i] = SPARKLINE_LEVELS[max_ns ? ns * LEVEL_COUNT / max_ns : 0];
+  }
+  sparkline[length] = '\0';
+
+  move(row, 1);
+  printw("%-17s %8.3f %8.3f |%-48s|", name,
+         count ? sum_ns / 1e6 / count : 0.0, max_ns / 1e6, sparkline);
+}
+
+void print_profiler(Canvas* canvas, Profiler* profiler) {
+  if (!profiler->is_overlay_visible) {
+    return;
+  }
+
+  uint row;
+  for (row = 1; row < PROFILE_STAGE_COUNT + 3; row++) {
+    invalidate_canvas_row(canvas, row);
+  }
+
+  attron(COLOR_PAIR(TEXT_COLOR_CODE));
+  move(1, 1);
+  printw("%-17s %8s %8s  last frames", "stage", "avg ms", "max ms");
+
+  uint stage;
+  for (stage = 0; stage < PROFILE_STAGE_COUNT; stage++) {
+    print_profile_row(profiler, stage + 2, PROFILE_STAGE_NAMES[stage], stage);
   }
+  print_profile_row(profiler, PROFILE_STAGE_COUNT + 2, "frame",
+                    PROFILE_STAGE_COUNT);
 }
@@ -1,13 +1,20 @@
 #ifndef DEBUG_H
 #define DEBUG_H
 
+#include "canvas.h"
 #include "lurker.h"
 #include "player.h"
+#include "profiler.h"
 #include "utils.h"
 
-void print_fps(float time_delta);
-void print_frame_number();
-void print_player_data(Player* player);
-void print_lurker_data(Lurker* lurkers, uint lurker_count);
+/* All of these draw over the canvas, the rows they use get invalidated */
+void print_fps(Canvas* canvas, float time_delta);
+void print_frame_number(Canvas* canvas);
+void print_player_data(Canvas* canvas, Player* player);
+void print_lurker_data(Canvas* canvas, Lurkers* lurkers);
+/* regeneration_ns is how long the last regenerate_level took, 0 if none */
+void print_level_data(Canvas* canvas, uint seed, unsigned long regeneration_ns);
+/* Per stage timings, only while Profiler.is_overlay_visible */
+void print_profiler(Canvas* canvas, Profiler* profiler);
 
 #endif
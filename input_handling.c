@@ -32,9 +32,11 @@ void handle_input(Arena* arena, int key) {
 
   uint pos_x = arena->player->position_x + d_x;
   uint pos_y = arena->player->position_y + d_y;
-  uint pos_i = pos_x + pos_y * arena->size_x;
+  if (pos_x >= arena->size_x || pos_y >= arena->size_y) {
+    return;
+  }
 
-  if (arena->data[pos_i] == FLOOR) {
+  if (TILE_PROPERTIES[get_arena_tile(arena, pos_x, pos_y)].is_walkable) {
     arena->player->position_x = pos_x;
     arena->player->position_y = pos_y;
   }
@@ -0,0 +1,148 @@
+/* pthreads and sysconf() are POSIX, hidden by -ansi unless requested */
+#define _POSIX_C_SOURCE 200112L
+
+#include "jobs.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+const uint JOBS_PER_THREAD = 4;
+
+uint get_cpu_count() {
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (uint)count : 1;
+}
+
+/* Called with the lock held, claims and runs jobs of the current batch until
+// none are left.
+*/
+void work_on_batch(JobSystem* jobs) {
+  while (jobs->next_job < jobs->job_count) {
+    uint job_idx = jobs->next_job;
+    jobs->next_job += 1;
+
+    pthread_mutex_unlock(&jobs->lock);
+    jobs->function(jobs->context, job_idx);
+    pthread_mutex_lock(&jobs->lock);
+
+    jobs->finished_jobs += 1;
+    if (jobs->finished_jobs == jobs->job_count) {
+      pthread_cond_broadcast(&jobs->batch_done);
+    }
+  }
+}
+
+void* run_worker(void* arg) {
+  JobSystem* jobs = arg;
+  uint last_batch_id = 0;
+
+  pthread_mutex_lock(&jobs->lock);
+  while (1) {
+    while (!jobs->is_shutting_down && jobs->batch_id == last_batch_id) {
+      pthread_cond_wait(&jobs->batch_ready, &jobs->lock);
+    }
+
+    if (jobs->is_shutting_down) {
+      break;
+    }
+
+    last_batch_id = jobs->batch_id;
+    work_on_batch(jobs);
+  }
+  pthread_mutex_unlock(&jobs->lock);
+
+  return NULL;
+}
+
+void init_job_system(JobSystem* jobs, uint thread_count) {
+  jobs->worker_count = thread_count > 1 ? thread_count - 1 : 0;
+  jobs->workers = NULL;
+  jobs->function = NULL;
+  jobs->context = NULL;
+  jobs->job_count = 0;
+  jobs->next_job = 0;
+  jobs->finished_jobs = 0;
+  jobs->batch_id = 0;
+  jobs->is_shutting_down = 0;
+
+  pthread_mutex_init(&jobs->lock, NULL);
+  pthread_cond_init(&jobs->batch_ready, NULL);
+  pthread_cond_init(&jobs->batch_done, NULL);
+
+  if (jobs->worker_count == 0) {
+    return;
+  }
+
+  jobs->workers = malloc(jobs->worker_count * sizeof(pthread_t));
+  assert(jobs->workers);
+
+  uint i;
+  for (i = 0; i < jobs->worker_count; i++) {
+    int error = pthread_create(&jobs->workers[i], NULL, run_worker, jobs);
+    assert(error == 0);
+  }
+}
+
+void free_job_system(JobSystem* jobs) {
+  pthread_mutex_lock(&jobs->lock);
+  jobs->is_shutting_down = 1;
+  pthread_cond_broadcast(&jobs->batch_ready);
+  pthread_mutex_unlock(&jobs->lock);
+
+  uint i;
+  for (i = 0; i < jobs->worker_count; i++) {
+    pthread_join(jobs->workers[i], NULL);
+  }
+  free(jobs->workers);
+
+  pthread_mutex_destroy(&jobs->lock);
+  pthread_cond_destroy(&jobs->batch_ready);
+  pthread_cond_destroy(&jobs->batch_done);
+}
+
+void run_jobs(JobSystem* jobs, JobFunction function, void* context,
+              uint job_count) {
+  uint i;
+  if (jobs->worker_count == 0 || job_count <= 1) {
+    for (i = 0; i < job_count; i++) {
+      function(context, i);
+    }
+    return;
+  }
+
+  pthread_mutex_lock(&jobs->lock);
+  jobs->function = function;
+  jobs->context = context;
+  jobs->job_count = job_count;
+  jobs->next_job = 0;
+  jobs->finished_jobs = 0;
+  jobs->batch_id += 1;
+  pthread_cond_broadcast(&jobs->batch_ready);
+
+  /* The calling thread helps out instead of idling */
+  work_on_batch(jobs);
+  while (jobs->finished_jobs < jobs->job_count) {
+    pthread_cond_wait(&jobs->batch_done, &jobs->lock);
+  }
+  pthread_mutex_unlock(&jobs->lock);
+}
+
+uint get_job_count(JobSystem* jobs, uint item_count, uint min_items_per_job) {
+  uint job_count = (jobs->worker_count + 1) * JOBS_PER_THREAD;
+  uint max_job_count = item_count / min_items_per_job;
+  job_count = job_count < max_job_count ? job_count : max_job_count;
+  return job_count > 0 ? job_count : 1;
+}
+
+void get_job_range(uint job_idx, uint job_count, uint item_count,
+                   uint alignment, uint* begin, uint* end) {
+  uint group_count = (item_count + alignment - 1) / alignment;
+  *begin = job_idx * group_count / job_count * alignment;
+  *end = (job_idx + 1) * group_count / job_count * alignment;
+  *begin = *begin < item_count ? *begin : item_count;
+  *end = *end < item_count ? *end : item_count;
+}
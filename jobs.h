@@ -0,0 +1,62 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <pthread.h>
+
+#include "utils.h"
+
+/* Minimal worker pool for the per-tick work that splits into independent
+// pieces (lurker updates, visibility). A frame is a fixed chain of stages,
+// run_jobs runs one stage across all threads and returns once it is done,
+// which is all the dependency tracking the frame needs.
+//
+// Jobs may read the arena and generate chunks (see get_arena_chunk), but
+// must not call set_arena_tile, stream_arena_chunks or anything else that
+// changes shared state.
+*/
+
+typedef void (*JobFunction)(void* context, uint job_idx);
+
+typedef struct {
+  /* Threads besides the one calling run_jobs, 0 runs everything inline */
+  uint worker_count;
+  pthread_t* workers;
+  pthread_mutex_t lock;
+  pthread_cond_t batch_ready;
+  pthread_cond_t batch_done;
+  /* Current batch, guarded by lock */
+  JobFunction function;
+  void* context;
+  uint job_count;
+  uint next_job;
+  uint finished_jobs;
+  uint batch_id;
+  byte is_shutting_down;
+} JobSystem;
+
+/* Online CPUs, at least 1 */
+uint get_cpu_count();
+
+/* thread_count includes the calling thread */
+void init_job_system(JobSystem* jobs, uint thread_count);
+void free_job_system(JobSystem* jobs);
+
+/* Runs function(context, i) for every i in [0, job_count), in no particular
+// order, and returns once all of them finished.
+*/
+void run_jobs(JobSystem* jobs, JobFunction function, void* context,
+              uint job_count);
+
+/* How many jobs to split item_count items into, so that every thread gets
+// a few of them to balance the load, and every job gets at least
+// min_items_per_job.
+*/
+uint get_job_count(JobSystem* jobs, uint item_count, uint min_items_per_job);
+
+/* Items [begin, end) of job job_idx out of job_count. Every job but the last
+// starts and ends on a multiple of alignment, e.g. for SIMD lanes.
+*/
+void get_job_range(uint job_idx, uint job_count, uint item_count,
+                   uint alignment, uint* begin, uint* end);
+
+#endif
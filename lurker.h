@@ -1,6 +1,8 @@
 #ifndef LURKER_H
 #define LURKER_H
 
+#include "bump_allocator.h"
+#include "spatial_hash.h"
 #include "utils.h"
 
 enum LurkerStatus {
@@ -10,15 +12,49 @@ enum LurkerStatus {
   WALKING_CAVE,
   /* Azimuth aligned to N*45d, changing rarely (~3s?) */
   WALKING_OFFICE,
+  /* Saw the player, heading for the tile it was last seen on */
+  CHASING,
 };
 
+/* All lurkers, stored as a structure of arrays. Lurker i is index i of every
+// array, update_lurkers runs its math over several lurkers at once, which
+// needs each property to be contiguous. Use add_lurker to add one.
+*/
 typedef struct {
-  float position_x, position_y;
-  float min_velocity, max_velocity;
-  float detection_cone_halfangle_rad;
-  float azimuth_target_rad, azimuth_current_rad;
-  uint status;
-  uint patrol_direction_timer;
-} Lurker;
+  /* Where the arrays come from, growing one leaves the old copy there */
+  BumpAllocator* memory;
+  uint count, capacity;
+  float* position_x;
+  float* position_y;
+  float* min_velocity;
+  float* max_velocity;
+  float* detection_cone_halfangle_rad;
+  /* In arena tiles, 0 means unlimited (rays stop only at walls) */
+  float* detection_range;
+  float* azimuth_target_rad;
+  float* azimuth_current_rad;
+  uint* status;
+  float* patrol_direction_timer;
+  /* Tile index (x + y * Arena.size_x) the lurker navigates to, along a
+  // flow field, or NO_NAV_TARGET to just wander.
+  */
+  uint* nav_target;
+  /* Own Rng stream of every lurker, so jitter doesn't depend on the update
+  // order. Word k of lurker i's state is rng_state[k][i], see rng.h.
+  */
+  uint* rng_state[4];
+  /* Lurkers by position, for neighbour queries. Rebuilt by update_lurkers
+  // once they have moved, see find_lurkers_in_radius.
+  */
+  SpatialHash grid;
+  /* Results of queries made from the main thread, holds every lurker */
+  uint* query_results;
+  /* Scratch for update_lurkers */
+  float* jitter;
+  float* next_x;
+  float* next_y;
+} Lurkers;
+
+extern const uint NO_NAV_TARGET;
 
 #endif
@@ -1,21 +1,21 @@
 #include "lurker_drawing.h"
 
 #include "colors.h"
+#include "lurker_logic.h"
 
-void draw_lurkers(Canvas* canvas, Lurker* lurkers, uint lurker_count,
-                  float time_delta) {
-  uint i, pos, pos_x, pos_y;
-  Lurker* lurker;
+void draw_lurkers(Canvas* canvas, Lurkers* lurkers, float time_delta) {
+  uint i, pos, min_x, min_y, max_x, max_y;
   CanvasTile* tile;
-  for (i = 0; i < lurker_count; i++) {
-    lurker = &lurkers[i];
-
+  get_canvas_bounds(canvas, &min_x, &min_y, &max_x, &max_y);
+  uint count = find_lurkers_in_rect(lurkers, min_x, min_y, max_x, max_y,
+                                    lurkers->query_results, lurkers->count);
+  uint k;
+  for (k = 0; k < count; k++) {
     /* TODO: Draw over 4 tiles, not just 1 */
 
-    pos_x = lurker->position_x * canvas->scale_x;
-    pos_y = lurker->position_y * canvas->scale_y;
-
-    pos = pos_x + pos_y * canvas->size_x;
+    i = lurkers->query_results[k];
+    pos = get_canvas_index(canvas, lurkers->position_x[i],
+                           lurkers->position_y[i]);
     tile = &canvas->data[pos];
     tile->can_light_pass = 0;
     tile->color_code = EXIT_COLOR_CODE;
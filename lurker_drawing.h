@@ -4,7 +4,6 @@
 #include "canvas.h"
 #include "lurker.h"
 
-void draw_lurkers(Canvas* canvas, Lurker* lurkers, uint lurker_count,
-                  float time_delta);
+void draw_lurkers(Canvas* canvas, Lurkers* lurkers, float time_delta);
 
 #endif
@@ -1,55 +1,386 @@
 #include "lurker_logic.h"
 
-#include <malloc.h>
+#include <assert.h>
 #include <math.h>
-#include <ncurses.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "arena.h"
+#include "bump_allocator.h"
+#include "jobs.h"
 #include "lurker.h"
+#include "navigation.h"
+#include "rng.h"
 #include "utils.h"
+#include "visibility.h"
+
+const uint NO_NAV_TARGET = (uint)-1;
+
+/* Lurkers heading for the same tile share its field */
+const uint LURKER_FLOW_FIELD_COUNT = 8;
+FlowFieldCache lurker_flow_fields = {NULL, 0, 0};
+/* Set up along with lurker_flow_fields, zeroed until then */
+RoomPathCache lurker_room_paths;
+/* Room graph searches per tick, lurkers over it keep their heading */
+const uint MAX_ROOM_SEARCHES_PER_STEER = 2;
+/* In tiles. Unlimited sight would make every detection and every vision
+// cone scale with the arena instead of with the lurker count.
+*/
+const float LURKER_DETECTION_RANGE = 20;
+/* Lurkers this close to one that spots the player join the chase */
+const float LURKER_ALERT_RADIUS = 6;
+
+void init_lurker_storage(Lurkers* lurkers, BumpAllocator* memory) {
+  lurkers->memory = memory;
+  lurkers->count = 0;
+  lurkers->capacity = 0;
+  lurkers->position_x = NULL;
+  lurkers->position_y = NULL;
+  lurkers->min_velocity = NULL;
+  lurkers->max_velocity = NULL;
+  lurkers->detection_cone_halfangle_rad = NULL;
+  lurkers->detection_range = NULL;
+  lurkers->azimuth_target_rad = NULL;
+  lurkers->azimuth_current_rad = NULL;
+  lurkers->status = NULL;
+  lurkers->patrol_direction_timer = NULL;
+  lurkers->nav_target = NULL;
+  lurkers->rng_state[0] = NULL;
+  lurkers->rng_state[1] = NULL;
+  lurkers->rng_state[2] = NULL;
+  lurkers->rng_state[3] = NULL;
+  lurkers->jitter = NULL;
+  lurkers->next_x = NULL;
+  lurkers->next_y = NULL;
+  init_spatial_hash(&lurkers->grid);
+  lurkers->query_results = NULL;
+}
+
+/* The arrays are level memory, they go away with the level */
+void free_lurker_storage(Lurkers* lurkers) {
+  free_spatial_hash(&lurkers->grid);
+  free_flow_field_cache(&lurker_flow_fields);
+  free_room_path_cache(&lurker_room_paths);
+  init_lurker_storage(lurkers, lurkers->memory);
+}
+
+/* Every array holds 4 byte elements, so a single helper grows all of them.
+// The outgrown array stays behind in level memory until the level ends.
+*/
+void* grow_lurker_array(Lurkers* lurkers, void* array, uint capacity) {
+  void* grown = bump_alloc(lurkers->memory, capacity * 4);
+  if (array) {
+    memcpy(grown, array, lurkers->count * 4);
+  }
+  return grown;
+}
+
+void reserve_lurkers(Lurkers* lurkers, uint capacity) {
+  assert(sizeof(float) == 4 && sizeof(uint) == 4);
+  if (capacity <= lurkers->capacity) {
+    return;
+  }
+
+  lurkers->position_x =
+      grow_lurker_array(lurkers, lurkers->position_x, capacity);
+  lurkers->position_y =
+      grow_lurker_array(lurkers, lurkers->position_y, capacity);
+  lurkers->min_velocity =
+      grow_lurker_array(lurkers, lurkers->min_velocity, capacity);
+  lurkers->max_velocity =
+      grow_lurker_array(lurkers, lurkers->max_velocity, capacity);
+  lurkers->detection_cone_halfangle_rad = grow_lurker_array(
+      lurkers, lurkers->detection_cone_halfangle_rad, capacity);
+  lurkers->detection_range =
+      grow_lurker_array(lurkers, lurkers->detection_range, capacity);
+  lurkers->azimuth_target_rad =
+      grow_lurker_array(lurkers, lurkers->azimuth_target_rad, capacity);
+  lurkers->azimuth_current_rad =
+      grow_lurker_array(lurkers, lurkers->azimuth_current_rad, capacity);
+  lurkers->status = grow_lurker_array(lurkers, lurkers->status, capacity);
+  lurkers->patrol_direction_timer =
+      grow_lurker_array(lurkers, lurkers->patrol_direction_timer, capacity);
+  lurkers->nav_target =
+      grow_lurker_array(lurkers, lurkers->nav_target, capacity);
+
+  int k;
+  for (k = 0; k < 4; k++) {
+    lurkers->rng_state[k] =
+        grow_lurker_array(lurkers, lurkers->rng_state[k], capacity);
+  }
+
+  lurkers->jitter = grow_lurker_array(lurkers, lurkers->jitter, capacity);
+  lurkers->next_x = grow_lurker_array(lurkers, lurkers->next_x, capacity);
+  lurkers->next_y = grow_lurker_array(lurkers, lurkers->next_y, capacity);
+  lurkers->query_results =
+      grow_lurker_array(lurkers, lurkers->query_results, capacity);
+  lurkers->capacity = capacity;
+}
+
+uint add_lurker(Lurkers* lurkers, float pos_x, float pos_y, uint seed) {
+  if (lurkers->count == lurkers->capacity) {
+    reserve_lurkers(lurkers, lurkers->capacity ? lurkers->capacity * 2 : 16);
+  }
+
+  uint i = lurkers->count;
+  lurkers->count += 1;
+
+  lurkers->detection_cone_halfangle_rad[i] = PI / 4;
+  lurkers->detection_range[i] = LURKER_DETECTION_RANGE;
+  lurkers->min_velocity[i] = 1.5;
+  lurkers->max_velocity[i] = 3.0;
+  lurkers->position_x[i] = pos_x;
+  lurkers->position_y[i] = pos_y;
+  lurkers->status[i] = WALKING_OFFICE;
+  lurkers->azimuth_current_rad[i] = 0;
+  lurkers->azimuth_target_rad[i] = PI;
+  lurkers->patrol_direction_timer[i] = 0;
+  lurkers->nav_target[i] = NO_NAV_TARGET;
+
+  Rng rng;
+  seed_rng(&rng, seed, LURKER_STREAM_BASE + i);
+  int k;
+  for (k = 0; k < 4; k++) {
+    lurkers->rng_state[k][i] = rng.s[k];
+  }
+
+  return i;
+}
+
+void init_lurkers(Arena* arena, uint seed) {
+  /* Spawns come from generation, scanning tiles would load every chunk */
+  reserve_lurkers(&arena->lurkers, arena->lurker_spawn_count);
+
+  uint i;
+  for (i = 0; i < arena->lurker_spawn_count; i++) {
+    uint spawn = arena->lurker_spawns[i];
+    add_lurker(&arena->lurkers, spawn % arena->size_x, spawn / arena->size_x,
+               seed);
+  }
+
+  index_lurkers(&arena->lurkers);
+}
+
+void index_lurkers(Lurkers* lurkers) {
+  build_spatial_hash(&lurkers->grid, lurkers->position_x, lurkers->position_y,
+                     lurkers->count);
+}
 
-void init_lurkers(Arena* arena) {
-  int i;
-  for (i = 0; i < arena->size_x * arena->size_y; i++) {
-    if (arena->data[i] != LURKER_SPAWN) {
+uint find_lurkers_in_radius(Lurkers* lurkers, float x, float y, float radius,
+                            uint* lurker_indices, uint capacity) {
+  return find_points_in_radius(&lurkers->grid, lurkers->position_x,
+                               lurkers->position_y, x, y, radius,
+                               lurker_indices, capacity);
+}
+
+uint find_lurkers_in_rect(Lurkers* lurkers, float min_x, float min_y,
+                          float max_x, float max_y, uint* lurker_indices,
+                          uint capacity) {
+  return find_points_in_rect(&lurkers->grid, lurkers->position_x,
+                             lurkers->position_y, min_x, min_y, max_x, max_y,
+                             lurker_indices, capacity);
+}
+
+void set_lurker_nav_target(Arena* arena, uint lurker_idx, uint x, uint y) {
+  arena->lurkers.nav_target[lurker_idx] = x + y * arena->size_x;
+}
+
+void clear_lurker_nav_target(Arena* arena, uint lurker_idx) {
+  arena->lurkers.nav_target[lurker_idx] = NO_NAV_TARGET;
+}
+
+void aim_lurker_at_tile(Lurkers* lurkers, uint i, uint x, uint y) {
+  float azimuth = atan2(y + 0.5f - lurkers->position_y[i],
+                        x + 0.5f - lurkers->position_x[i]);
+  lurkers->azimuth_target_rad[i] = azimuth < 0 ? azimuth + PI * 2 : azimuth;
+}
+
+/* Next tile on the way through a doorway out of room. Rooms are convex, so
+// the near end of the corridor is straight ahead from anywhere in the room,
+// and once lined up with the corridor, so is its far end.
+*/
+void get_doorway_waypoint(Arena* arena, uint door_idx, uint room, uint pos_x,
+                          uint pos_y, uint* x, uint* y) {
+  DoorwaySeed* door = &arena->doorways[door_idx];
+  uint next_room = room == door->room_a ? door->room_b : door->room_a;
+  uint near_x, near_y;
+  get_doorway_end(door, room, &near_x, &near_y);
+  get_doorway_end(door, next_room, x, y);
+
+  byte is_along_x = door->a_y == door->b_y;
+  byte is_lined_up = is_along_x ? pos_y == near_y : pos_x == near_x;
+  if (!is_lined_up) {
+    *x = near_x;
+    *y = near_y;
+  }
+}
+
+/* Rooms are generated as empty rectangles, only edits can put anything in
+// the way of a straight line across one.
+*/
+byte is_room_edited(Arena* arena, uint room) {
+  RoomSeed* seed = &arena->room_seeds[room];
+  uint chunk_x, chunk_y;
+  for (chunk_y = seed->floor_y0 >> ARENA_CHUNK_SHIFT;
+       chunk_y <= (seed->floor_y1 - 1) >> ARENA_CHUNK_SHIFT; chunk_y++) {
+    for (chunk_x = seed->floor_x0 >> ARENA_CHUNK_SHIFT;
+         chunk_x <= (seed->floor_x1 - 1) >> ARENA_CHUNK_SHIFT; chunk_x++) {
+      if (arena->chunks[chunk_x + chunk_y * arena->chunks_x].is_modified) {
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/* Points lurkers with a target at their next waypoint. Serial, the shared
+// caches aren't thread safe and steering is cheap next to the update itself.
+// Lurkers in another room than their target follow the room graph, the
+// last room is only refined down to tiles, with a flow field, if it has
+// been edited.
+*/
+void steer_lurkers(Arena* arena) {
+  Lurkers* lurkers = &arena->lurkers;
+  lurker_room_paths.search_budget = MAX_ROOM_SEARCHES_PER_STEER;
+
+  uint i;
+  for (i = 0; i < lurkers->count; i++) {
+    uint target = lurkers->nav_target[i];
+    if (target == NO_NAV_TARGET) {
+      continue;
+    }
+
+    if (lurker_flow_fields.fields == NULL) {
+      init_flow_field_cache(&lurker_flow_fields, LURKER_FLOW_FIELD_COUNT);
+      init_room_path_cache(&lurker_room_paths, arena->room_seed_count);
+      lurker_room_paths.search_budget = MAX_ROOM_SEARCHES_PER_STEER;
+    }
+
+    uint target_x = target % arena->size_x;
+    uint target_y = target / arena->size_x;
+    uint pos_x = lurkers->position_x[i];
+    uint pos_y = lurkers->position_y[i];
+    if (pos_x == target_x && pos_y == target_y) {
+      lurkers->nav_target[i] = NO_NAV_TARGET;
       continue;
     }
 
-    /* TODO: Move entire lurker init logic to map generation
-    // - Removes need for LURKER_SPAWN, PLAYER_SPAWN, etc
-    // - Just as simple in handling if we isolate to add_lurker
-    */
+    /* Targets in a corridor are reached from the room at its a end */
+    uint target_room = get_room_at(arena, target_x, target_y);
+    uint target_door = get_doorway_at(arena, target_x, target_y);
+    if (target_room == NO_ROOM && target_door != NO_DOORWAY) {
+      target_room = arena->doorways[target_door].room_a;
+    }
 
-    arena->data[i] = FLOOR;
+    uint room = get_room_at(arena, pos_x, pos_y);
+    uint door_idx = room == NO_ROOM ? get_doorway_at(arena, pos_x, pos_y)
+                                    : NO_DOORWAY;
+    uint next_x, next_y;
 
-    if (arena->lurker_count == arena->lurker_capacity) {
-      arena->lurker_capacity *= 2;
-      arena->lurkers = realloc(arena->lurkers, arena->lurker_capacity);
+    if (target_room != NO_ROOM && room != NO_ROOM && room != target_room) {
+      uint next_door =
+          get_next_doorway(&lurker_room_paths, arena, room, target_room);
+      if (next_door == DOORWAY_NOT_PLANNED) {
+        continue;
+      }
+      if (next_door == NO_DOORWAY) {
+        lurkers->nav_target[i] = NO_NAV_TARGET;
+        continue;
+      }
+      get_doorway_waypoint(arena, next_door, room, pos_x, pos_y, &next_x,
+                           &next_y);
+      aim_lurker_at_tile(lurkers, i, next_x, next_y);
+      continue;
     }
 
-    uint pos_x = i % arena->size_x;
-    uint pos_y = (i - pos_x) / arena->size_y;
+    if (target_room != NO_ROOM && door_idx != NO_DOORWAY &&
+        door_idx != target_door) {
+      /* In a corridor, out at whichever end the path continues from */
+      DoorwaySeed* door = &arena->doorways[door_idx];
+      uint next_door =
+          door->room_a == target_room || door->room_b == target_room
+              ? NO_DOORWAY
+              : get_next_doorway(&lurker_room_paths, arena, door->room_a,
+                                 target_room);
+      if (next_door == DOORWAY_NOT_PLANNED) {
+        continue;
+      }
+      byte is_to_b = door->room_b == target_room || next_door == door_idx;
+      get_doorway_end(door, is_to_b ? door->room_b : door->room_a, &next_x,
+                      &next_y);
+      aim_lurker_at_tile(lurkers, i, next_x, next_y);
+      continue;
+    }
 
-    Lurker new_lurker;
+    if (room != NO_ROOM && room == target_room &&
+        !is_room_edited(arena, room)) {
+      aim_lurker_at_tile(lurkers, i, target_x, target_y);
+      continue;
+    }
 
-    new_lurker.detection_cone_halfangle_rad = PI / 4;
-    new_lurker.min_velocity = 1.5;
-    new_lurker.max_velocity = 3.0;
-    new_lurker.position_x = pos_x;
-    new_lurker.position_y = pos_y;
-    new_lurker.status = WALKING_OFFICE;
-    new_lurker.azimuth_current_rad = 0;
-    new_lurker.azimuth_target_rad = PI;
-    new_lurker.patrol_direction_timer = 0;
+    FlowField* field =
+        get_flow_field(&lurker_flow_fields, arena, target_x, target_y);
+    byte direction = get_flow_direction(field, pos_x, pos_y);
+    if (direction == FLOW_NONE) {
+      /* Unreachable or too far away, let the lurker wander instead */
+      lurkers->nav_target[i] = NO_NAV_TARGET;
+      continue;
+    }
 
-    arena->lurkers[arena->lurker_count] = new_lurker;
-    arena->lurker_count += 1;
+    aim_lurker_at_tile(lurkers, i, pos_x + FLOW_DIRECTION_X[direction],
+                       pos_y + FLOW_DIRECTION_Y[direction]);
   }
 }
 
-void update_lurkers(Arena* arena, float time_delta) {
+const float APPROX_PI = 3.14159265f;
+const float APPROX_HALF_PI = 1.57079633f;
+const float APPROX_TWO_PI = 6.28318531f;
+
+/* fmodf() as x - trunc(x / m) * m, with the same sign rules */
+float fmod_approx(float x, float m) { return x - m * (float)(int)(x / m); }
+
+/* x - floor(x / m) * m, always in [0, m) */
+float wrap_approx(float x, float m) {
+  float q = x / m;
+  float t = (float)(int)q;
+  t -= t > q ? 1 : 0;
+  return x - m * t;
+}
+
+/* sin() for the lurker math below. Taylor series on [-pi/2, pi/2] after
+// folding the angle into that range, max error ~4e-6.
+// The scalar functions here are written with operations SSE has an exact
+// counterpart of (min/max as a < b ? a : b, fabs as a sign mask, ...), so the
+// SSE kernel gives bit for bit the same results as the scalar fallback.
+*/
+float sin_approx(float x) {
+  float r = fmod_approx(x, APPROX_TWO_PI);
+  r -= r > APPROX_PI ? APPROX_TWO_PI : 0;
+  r += r < -APPROX_PI ? APPROX_TWO_PI : 0;
+
+  float folded = APPROX_PI - r;
+  r = r < folded ? r : folded;
+  folded = -APPROX_PI - r;
+  r = r > folded ? r : folded;
+
+  float r2 = r * r;
+  float p = 1.0f / 362880;
+  p = p * r2 - 1.0f / 5040;
+  p = p * r2 + 1.0f / 120;
+  p = p * r2 - 1.0f / 6;
+  p = p * r2 + 1;
+  return p * r;
+}
+
+/* The per-lurker math, everything except the collision test against the
+// map. Results go to next_x / next_y, see update_lurkers.
+*/
+void update_lurker_lane(Lurkers* lurkers, uint i, float time_delta) {
   const float EPSILON_FOR_JITTER = PI / 18;
-  const float JITTER_RADIUS = PI / 12;
   const float MAX_CHANGE_PER_S = PI / 2;
 
   /*
@@ -61,51 +392,260 @@ void update_lurkers(Arena* arena, float time_delta) {
   // 2.1. No RNG just fill total velocity to 100%
   */
 
-  int i;
-  for (i = 0; i < arena->lurker_count; i++) {
-    Lurker* lurker = &arena->lurkers[i];
-    /* TODO: Add velocity system, it's not trivial due to overshooting etc,
-    //       but it would look much better than the current linear approach.
-    //       ^^^ But it is neccessary for the energy thing to even make sense.
-    */
+  /* TODO: Add velocity system, it's not trivial due to overshooting etc,
+  //       but it would look much better than the current linear approach.
+  //       ^^^ But it is neccessary for the energy thing to even make sense.
+  */
+
+  float az_curr = lurkers->azimuth_current_rad[i];
+  float az_diff = lurkers->azimuth_target_rad[i] - az_curr;
+  float delta = wrap_approx(az_diff + PI, PI * 2) - PI;
+
+  float change_per_s = clampf(delta, -MAX_CHANGE_PER_S, MAX_CHANGE_PER_S);
+
+  float abs_delta = fabs(delta);
+  if (abs_delta < EPSILON_FOR_JITTER) {
+    change_per_s = lurkers->jitter[i];
+  }
+
+  float abs_change_per_s = fabs(change_per_s);
+  float energy_ratio_remaining = 1 - abs_change_per_s / MAX_CHANGE_PER_S;
+  float move_speed_per_s =
+      energy_ratio_remaining *
+          (lurkers->max_velocity[i] - lurkers->min_velocity[i]) +
+      lurkers->min_velocity[i];
+  float velocity = move_speed_per_s * time_delta;
+
+  /* TODO: Getting weird random behaviour with OOB,
+   * check if velocity maybe is getting to some extremes */
+  lurkers->next_x[i] =
+      lurkers->position_x[i] + sin_approx(az_curr + APPROX_HALF_PI) * velocity;
+  lurkers->next_y[i] = lurkers->position_y[i] + sin_approx(az_curr) * velocity;
+
+  float change_per_frame = change_per_s * time_delta;
+  lurkers->azimuth_current_rad[i] =
+      wrap_approx(az_curr + change_per_frame, PI * 2);
+  lurkers->patrol_direction_timer[i] += time_delta;
+
+  /* DEBUG: TODO remove this, wandering lurkers just spin for now */
+  if (lurkers->nav_target[i] == NO_NAV_TARGET) {
+    lurkers->azimuth_target_rad[i] += time_delta;
+  }
+}
+
+#ifdef __SSE2__
+__m128 trunc_sse2(__m128 x) { return _mm_cvtepi32_ps(_mm_cvttps_epi32(x)); }
+
+__m128 fmod_approx_sse2(__m128 x, __m128 m) {
+  return _mm_sub_ps(x, _mm_mul_ps(m, trunc_sse2(_mm_div_ps(x, m))));
+}
+
+__m128 wrap_approx_sse2(__m128 x, __m128 m) {
+  __m128 q = _mm_div_ps(x, m);
+  __m128 t = trunc_sse2(q);
+  t = _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, q), _mm_set1_ps(1)));
+  return _mm_sub_ps(x, _mm_mul_ps(m, t));
+}
+
+__m128 sin_approx_sse2(__m128 x) {
+  __m128 pi = _mm_set1_ps(APPROX_PI);
+  __m128 two_pi = _mm_set1_ps(APPROX_TWO_PI);
+
+  __m128 minus_pi = _mm_set1_ps(-APPROX_PI);
+
+  __m128 r = fmod_approx_sse2(x, two_pi);
+  r = _mm_sub_ps(r, _mm_and_ps(_mm_cmpgt_ps(r, pi), two_pi));
+  r = _mm_add_ps(r, _mm_and_ps(_mm_cmplt_ps(r, minus_pi), two_pi));
+
+  r = _mm_min_ps(r, _mm_sub_ps(pi, r));
+  r = _mm_max_ps(r, _mm_sub_ps(minus_pi, r));
+
+  __m128 r2 = _mm_mul_ps(r, r);
+  __m128 p = _mm_set1_ps(1.0f / 362880);
+  p = _mm_sub_ps(_mm_mul_ps(p, r2), _mm_set1_ps(1.0f / 5040));
+  p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(1.0f / 120));
+  p = _mm_sub_ps(_mm_mul_ps(p, r2), _mm_set1_ps(1.0f / 6));
+  p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(1));
+  return _mm_mul_ps(p, r);
+}
+
+/* update_lurker_lane on lurkers i .. i + 3, bit for bit the same results */
+void update_lurker_lanes_sse2(Lurkers* lurkers, uint i, float time_delta) {
+  const float EPSILON_FOR_JITTER = PI / 18;
+  const float MAX_CHANGE_PER_S = PI / 2;
+
+  __m128 sign_mask = _mm_set1_ps(-0.0f);
+  __m128 pi = _mm_set1_ps(PI);
+  __m128 max_change = _mm_set1_ps(MAX_CHANGE_PER_S);
+  __m128 dt = _mm_set1_ps(time_delta);
+
+  __m128 az_curr = _mm_loadu_ps(lurkers->azimuth_current_rad + i);
+  __m128 az_target = _mm_loadu_ps(lurkers->azimuth_target_rad + i);
+  __m128 az_diff = _mm_sub_ps(az_target, az_curr);
+  __m128 delta = _mm_sub_ps(
+      wrap_approx_sse2(_mm_add_ps(az_diff, pi), _mm_set1_ps(PI * 2)), pi);
+
+  /* clampf(delta, -max_change, max_change) */
+  __m128 change_per_s =
+      _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), max_change), delta);
+  change_per_s = _mm_min_ps(max_change, change_per_s);
+
+  __m128 use_jitter = _mm_cmplt_ps(_mm_andnot_ps(sign_mask, delta),
+                                   _mm_set1_ps(EPSILON_FOR_JITTER));
+  change_per_s =
+      _mm_or_ps(_mm_and_ps(use_jitter, _mm_loadu_ps(lurkers->jitter + i)),
+                _mm_andnot_ps(use_jitter, change_per_s));
+
+  __m128 energy_ratio_remaining = _mm_sub_ps(
+      _mm_set1_ps(1),
+      _mm_div_ps(_mm_andnot_ps(sign_mask, change_per_s), max_change));
+  __m128 min_velocity = _mm_loadu_ps(lurkers->min_velocity + i);
+  __m128 max_velocity = _mm_loadu_ps(lurkers->max_velocity + i);
+  __m128 move_speed_per_s =
+      _mm_add_ps(_mm_mul_ps(energy_ratio_remaining,
+                            _mm_sub_ps(max_velocity, min_velocity)),
+                 min_velocity);
+  __m128 velocity = _mm_mul_ps(move_speed_per_s, dt);
+
+  __m128 cos_az =
+      sin_approx_sse2(_mm_add_ps(az_curr, _mm_set1_ps(APPROX_HALF_PI)));
+  __m128 sin_az = sin_approx_sse2(az_curr);
+  _mm_storeu_ps(lurkers->next_x + i,
+                _mm_add_ps(_mm_loadu_ps(lurkers->position_x + i),
+                           _mm_mul_ps(cos_az, velocity)));
+  _mm_storeu_ps(lurkers->next_y + i,
+                _mm_add_ps(_mm_loadu_ps(lurkers->position_y + i),
+                           _mm_mul_ps(sin_az, velocity)));
 
-    float az_curr = lurker->azimuth_current_rad;
-    float az_diff = lurker->azimuth_target_rad - az_curr;
-    float delta = fmodf(az_diff + PI, PI * 2) - PI;
+  __m128 change_per_frame = _mm_mul_ps(change_per_s, dt);
+  _mm_storeu_ps(lurkers->azimuth_current_rad + i,
+                wrap_approx_sse2(_mm_add_ps(az_curr, change_per_frame),
+                                 _mm_set1_ps(PI * 2)));
+  _mm_storeu_ps(
+      lurkers->patrol_direction_timer + i,
+      _mm_add_ps(_mm_loadu_ps(lurkers->patrol_direction_timer + i), dt));
+  __m128 is_wandering = _mm_castsi128_ps(
+      _mm_cmpeq_epi32(_mm_loadu_si128((__m128i*)(lurkers->nav_target + i)),
+                      _mm_set1_epi32((int)NO_NAV_TARGET)));
+  _mm_storeu_ps(lurkers->azimuth_target_rad + i,
+                _mm_add_ps(az_target, _mm_and_ps(is_wandering, dt)));
+}
+#endif
+
+/* Lurkers don't interact with each other, so any range of them can be
+// updated independently, begin has to be a multiple of 4.
+*/
+byte is_lurker_move_free(Arena* arena, float x, float y) {
+  return x >= 0 && y >= 0 && x < arena->size_x && y < arena->size_y &&
+         TILE_PROPERTIES[get_arena_tile(arena, x, y)].is_walkable;
+}
+
+void update_lurker_range(Arena* arena, uint begin, uint end,
+                         float time_delta) {
+  const float JITTER_RADIUS = PI / 12;
+  Lurkers* lurkers = &arena->lurkers;
+
+  /* Every lurker draws its jitter each tick, whether it is used or not,
+  // which keeps the draws branch-free.
+  */
+  uint* rng_state[4];
+  int k;
+  for (k = 0; k < 4; k++) {
+    rng_state[k] = lurkers->rng_state[k] + begin;
+  }
+  fill_rand_f_lanes(rng_state, lurkers->jitter + begin, end - begin,
+                    -JITTER_RADIUS, JITTER_RADIUS);
 
-    float change_per_s = clampf(delta, -MAX_CHANGE_PER_S, MAX_CHANGE_PER_S);
+  uint i = begin;
+#ifdef __SSE2__
+  for (; i + 4 <= end; i += 4) {
+    update_lurker_lanes_sse2(lurkers, i, time_delta);
+  }
+#endif
+  for (; i < end; i++) {
+    update_lurker_lane(lurkers, i, time_delta);
+  }
 
-    if (fabsf(delta) < EPSILON_FOR_JITTER) {
-      change_per_s = rand_f(-JITTER_RADIUS, JITTER_RADIUS);
+  /* Map lookups don't vectorize, moves are validated one by one. A move
+  // into a wall keeps whichever axis is free, sliding along the wall.
+  */
+  for (i = begin; i < end; i++) {
+    float pos_x = lurkers->position_x[i];
+    float pos_y = lurkers->position_y[i];
+    float next_x = lurkers->next_x[i];
+    float next_y = lurkers->next_y[i];
+    if (is_lurker_move_free(arena, next_x, next_y)) {
+      lurkers->position_x[i] = next_x;
+      lurkers->position_y[i] = next_y;
+    } else if (is_lurker_move_free(arena, next_x, pos_y)) {
+      lurkers->position_x[i] = next_x;
+    } else if (is_lurker_move_free(arena, pos_x, next_y)) {
+      lurkers->position_y[i] = next_y;
     }
+  }
+}
+
+typedef struct {
+  Arena* arena;
+  float time_delta;
+  uint job_count;
+} LurkerUpdateJobs;
+
+void run_lurker_update_job(void* context, uint job_idx) {
+  LurkerUpdateJobs* update = context;
+  uint begin, end;
+  get_job_range(job_idx, update->job_count, update->arena->lurkers.count, 4,
+                &begin, &end);
+  update_lurker_range(update->arena, begin, end, update->time_delta);
+}
 
-    float energy_ratio_remaining = 1 - fabsf(change_per_s) / MAX_CHANGE_PER_S;
-    float move_speed_per_s =
-        energy_ratio_remaining * (lurker->max_velocity - lurker->min_velocity) +
-        lurker->min_velocity;
-    float velocity = move_speed_per_s * time_delta;
-
-    /* TODO: Getting weird random behaviour with OOB,
-     * check if velocity maybe is getting to some extremes */
-    float vel_x = cos(az_curr) * velocity;
-    float vel_y = sin(az_curr) * velocity;
-
-    uint pos_x = lurker->position_x + vel_x;
-    uint pos_y = lurker->position_y + vel_y;
-    uint pos_i = pos_x + pos_y * arena->size_x;
-
-    if (pos_i >= 0 && pos_i < arena->size_x * arena->size_y &&
-        arena->data[pos_i] == FLOOR) {
-      lurker->position_x = pos_x;
-      lurker->position_y = pos_y;
+/* Runs every tick before steering. Lurkers that see the player chase the
+// tile they saw it on, and alert the ones around them to do the same. Ones
+// that got there without seeing it again go back to patrolling.
+*/
+void detect_player(Arena* arena) {
+  Lurkers* lurkers = &arena->lurkers;
+  uint player_x = arena->player->position_x;
+  uint player_y = arena->player->position_y;
+
+  uint i;
+  for (i = 0; i < lurkers->count; i++) {
+    if (lurkers->status[i] == CHASING &&
+        lurkers->nav_target[i] == NO_NAV_TARGET) {
+      lurkers->status[i] = WALKING_OFFICE;
     }
 
-    float change_per_frame = change_per_s * time_delta;
-    lurker->azimuth_current_rad = fmodf(az_curr + change_per_frame, PI) + PI;
-    lurker->patrol_direction_timer += time_delta;
+    /* lurker_can_see rejects by range first, far lurkers cost a compare */
+    if (!lurker_can_see(arena, i, player_x, player_y)) {
+      continue;
+    }
 
-    /* DEBUG: TODO remove this */
-    lurker->azimuth_target_rad += time_delta;
+    /* The spotter included, it is within its own radius */
+    uint alerted_count = find_lurkers_in_radius(
+        lurkers, lurkers->position_x[i], lurkers->position_y[i],
+        LURKER_ALERT_RADIUS, lurkers->query_results, lurkers->count);
+    uint k;
+    for (k = 0; k < alerted_count; k++) {
+      lurkers->status[lurkers->query_results[k]] = CHASING;
+      set_lurker_nav_target(arena, lurkers->query_results[k], player_x,
+                            player_y);
+    }
   }
 }
 
+void update_lurkers(Arena* arena, float time_delta, JobSystem* jobs) {
+  /* Below this, a job costs more to hand out than to run */
+  const uint MIN_LURKERS_PER_JOB = 256;
+
+  detect_player(arena);
+  steer_lurkers(arena);
+
+  LurkerUpdateJobs update;
+  update.arena = arena;
+  update.time_delta = time_delta;
+  update.job_count =
+      get_job_count(jobs, arena->lurkers.count, MIN_LURKERS_PER_JOB);
+  run_jobs(jobs, run_lurker_update_job, &update, update.job_count);
+
+  index_lurkers(&arena->lurkers);
+}
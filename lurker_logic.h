@@ -2,8 +2,33 @@
 #define LURKER_LOGIC_H
 
 #include "arena.h"
+#include "bump_allocator.h"
+#include "jobs.h"
+#include "lurker.h"
 
-void init_lurkers(Arena* arena);
-void update_lurkers(Arena* arena, float time_delta);
+/* Arrays are allocated from memory, normally Arena.level_memory */
+void init_lurker_storage(Lurkers* lurkers, BumpAllocator* memory);
+void free_lurker_storage(Lurkers* lurkers);
+void reserve_lurkers(Lurkers* lurkers, uint capacity);
+/* Returns the new lurker's index, seed is the run's seed, see init_lurkers */
+uint add_lurker(Lurkers* lurkers, float pos_x, float pos_y, uint seed);
+
+void set_lurker_nav_target(Arena* arena, uint lurker_idx, uint x, uint y);
+void clear_lurker_nav_target(Arena* arena, uint lurker_idx);
+
+/* seed is the run's seed, every lurker gets its own stream derived from it */
+void init_lurkers(Arena* arena, uint seed);
+void update_lurkers(Arena* arena, float time_delta, JobSystem* jobs);
+
+/* Rebuilds Lurkers.grid, update_lurkers and init_lurkers do this already.
+// Lurkers added or moved since the last rebuild aren't found by queries.
+*/
+void index_lurkers(Lurkers* lurkers);
+/* Neighbour queries over Lurkers.grid, see find_points_in_rect */
+uint find_lurkers_in_radius(Lurkers* lurkers, float x, float y, float radius,
+                            uint* lurker_indices, uint capacity);
+uint find_lurkers_in_rect(Lurkers* lurkers, float min_x, float min_y,
+                          float max_x, float max_y, uint* lurker_indices,
+                          uint capacity);
 
 #endif
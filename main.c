@@ -2,25 +2,103 @@
 #include <ncurses.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "arena.h"
 #include "arena_drawing.h"
+#include "arena_file.h"
 #include "canvas.h"
+#include "canvas_printing.h"
 #include "colors.h"
 #include "debug.h"
 #include "input_handling.h"
+#include "jobs.h"
 #include "lurker_drawing.h"
 #include "lurker_logic.h"
 #include "player.h"
 #include "player_drawing.h"
+#include "profiler.h"
 #include "rays.h"
+#include "timing.h"
 
-int main() {
+int main(int argc, char** argv) {
   Arena arena;
   Player player = {10, 10};
   Canvas canvas;
-  /* View view; */
+
+  uint arena_size_x = DEFAULT_ARENA_SIZE;
+  uint arena_size_y = DEFAULT_ARENA_SIZE;
+  const char* load_path = NULL;
+  const char* save_path = NULL;
+  /* Profile dump written on exit, a Chrome trace for .json, else CSV */
+  const char* profile_path = NULL;
+  /* Printed on exit, pass it back with -r to replay the same run */
+  uint seed = (uint)time(NULL);
+  uint thread_count = get_cpu_count();
+
+  int arg = 1;
+  while (arg + 1 < argc && argv[arg][0] == '-') {
+    if (strcmp(argv[arg], "-l") == 0) {
+      load_path = argv[arg + 1];
+    } else if (strcmp(argv[arg], "-s") == 0) {
+      save_path = argv[arg + 1];
+    } else if (strcmp(argv[arg], "-r") == 0) {
+      seed = (uint)strtoul(argv[arg + 1], NULL, 10);
+    } else if (strcmp(argv[arg], "-j") == 0) {
+      thread_count = (uint)strtoul(argv[arg + 1], NULL, 10);
+    } else if (strcmp(argv[arg], "-p") == 0) {
+      profile_path = argv[arg + 1];
+    } else {
+      break;
+    }
+    arg += 2;
+  }
+
+  if (argc > arg) {
+    arena_size_x = (uint)strtoul(argv[arg], NULL, 10);
+    arena_size_y = arena_size_x;
+  }
+
+  if (argc > arg + 1) {
+    arena_size_y = (uint)strtoul(argv[arg + 1], NULL, 10);
+  }
+
+  if (thread_count == 0 ||
+      !is_arena_size_valid(arena_size_x, arena_size_y)) {
+    printf("usage: %s [-l load_file] [-s save_file] [-r seed] [-j threads] "
+           "[-p profile_file] [width] [height]\n",
+           argv[0]);
+    printf("Arena sides have to be between %u and %u.\n", MIN_ARENA_SIZE,
+           MAX_ARENA_SIZE);
+    return 1;
+  }
+
+  ArenaGenerationStatus gen_status = ARENA_GENERATION_OK;
+  ArenaFileStatus file_status;
+
+  if (load_path) {
+    file_status = load_arena(&arena, &player, load_path);
+    if (file_status != ARENA_FILE_OK) {
+      printf("Couldn't load %s: %s.\n", load_path,
+             describe_arena_file_status(file_status));
+      return 1;
+    }
+  } else {
+    init_arena(&arena, &player, arena_size_x, arena_size_y);
+    gen_status = generate_arena(&arena, seed);
+  }
+  spawn_player(&arena);
+
+  if (save_path) {
+    file_status = save_arena(&arena, save_path);
+    if (file_status != ARENA_FILE_OK) {
+      printf("Couldn't save %s: %s.\n", save_path,
+             describe_arena_file_status(file_status));
+      free_arena(&arena);
+      return 1;
+    }
+  }
 
   initscr();
   cbreak();
@@ -29,20 +107,50 @@ int main() {
   nodelay(stdscr, TRUE);
 
   init_colors();
-  init_arena(&arena, &player);
-  init_canvas(&canvas, &arena);
-  generate_arena(&arena);
-  init_lurkers(&arena);
+  /* The view fills the terminal, every arena tile is 2 columns wide */
+  int terminal_rows, terminal_cols;
+  getmaxyx(stdscr, terminal_rows, terminal_cols);
+  init_canvas(&canvas, &arena, terminal_cols / 2, terminal_rows);
+  init_lurkers(&arena, seed);
+
+  JobSystem jobs;
+  init_job_system(&jobs, thread_count);
 
-  /* TD logic copied from:
-  https://sourceware.org/glibc/manual/latest/html_mono/libc.html#Calculating-Elapsed-Time
+  Profiler profiler;
+  init_profiler(&profiler);
+
+  /* Fixed timestep, the simulation advances in ticks of exactly
+  // 1 / SIMULATION_HZ, as many per frame as wall time has passed, and
+  // frames are drawn at most MAX_FRAMES_PER_S, sleeping in between.
+  // Behaviour only depends on the seed and input, not on the frame rate.
+  */
+  const uint MAX_FRAMES_PER_S = 60;
+  /* After a stall, the simulation slows down rather than trying to catch
+  // up with a burst of ticks that would stall the next frame even more.
   */
+  const uint MAX_TICKS_PER_FRAME = 5;
 
-  clock_t start, end;
-  float time_delta = 1.0;
+  const float tick_s = 1.0f / SIMULATION_HZ;
+  const unsigned long tick_ns = 1000000000UL / SIMULATION_HZ;
+  const unsigned long frame_ns = 1000000000UL / MAX_FRAMES_PER_S;
+
+  unsigned long previous_frame_start = now_ns();
+  unsigned long unsimulated_ns = 0;
+  float frame_delta = tick_s;
+
+  /* Every regeneration moves on to the next seed, the current one is shown
+  // so a level can be replayed with -r.
+  */
+  uint level_seed = seed;
+  unsigned long regeneration_ns = 0;
 
   while (1) {
-    start = clock();
+    begin_profile_frame(&profiler);
+    unsigned long frame_start = now_ns();
+    unsimulated_ns += frame_start - previous_frame_start;
+    if (unsimulated_ns > MAX_TICKS_PER_FRAME * tick_ns) {
+      unsimulated_ns = MAX_TICKS_PER_FRAME * tick_ns;
+    }
 
     int input;
     while ((input = getch()) != ERR) {
@@ -50,42 +158,95 @@ int main() {
         case 'q':
           goto end_game_loop;
           break;
+        case 'p':
+          profiler.is_overlay_visible = !profiler.is_overlay_visible;
+          break;
+        case 'r':
+          regeneration_ns = now_ns();
+          level_seed += 1;
+          gen_status = regenerate_level(&arena, level_seed);
+          regeneration_ns = now_ns() - regeneration_ns;
+          break;
         default:
           handle_input(&arena, input);
           break;
       }
     }
 
-    /* TODO: Wrap Canvas with a cropping, zoomed View */
+    while (unsimulated_ns >= tick_ns) {
+      begin_profile_stage(&profiler, PROFILE_STREAM_CHUNKS);
+      stream_arena_chunks(&arena);
+      end_profile_stage(&profiler, PROFILE_STREAM_CHUNKS);
+      begin_profile_stage(&profiler, PROFILE_UPDATE_LURKERS);
+      update_lurkers(&arena, tick_s, &jobs);
+      end_profile_stage(&profiler, PROFILE_UPDATE_LURKERS);
+      unsimulated_ns -= tick_ns;
+    }
 
-    update_lurkers(&arena, time_delta);
+    center_view(&canvas.view, &arena, player.position_x, player.position_y);
 
+    begin_profile_stage(&profiler, PROFILE_DRAW_ARENA);
     draw_arena(&canvas, &arena);
+    end_profile_stage(&profiler, PROFILE_DRAW_ARENA);
+    begin_profile_stage(&profiler, PROFILE_DRAW_PLAYER);
     draw_player(&canvas, &arena);
-    draw_lurker_rays(&canvas, &arena);
-    draw_lurkers(&canvas, arena.lurkers, arena.lurker_count, time_delta);
+    end_profile_stage(&profiler, PROFILE_DRAW_PLAYER);
+    begin_profile_stage(&profiler, PROFILE_DRAW_LURKER_RAYS);
+    draw_lurker_rays(&canvas, &arena, &jobs);
+    end_profile_stage(&profiler, PROFILE_DRAW_LURKER_RAYS);
+    begin_profile_stage(&profiler, PROFILE_DRAW_LURKERS);
+    draw_lurkers(&canvas, &arena.lurkers, frame_delta);
+    end_profile_stage(&profiler, PROFILE_DRAW_LURKERS);
 
+    begin_profile_stage(&profiler, PROFILE_PRINT_CANVAS);
     print_canvas(&canvas);
-    print_fps(time_delta);
-    print_frame_number();
-    print_player_data(&player);
-    print_lurker_data(arena.lurkers, arena.lurker_count);
+    end_profile_stage(&profiler, PROFILE_PRINT_CANVAS);
+    print_fps(&canvas, frame_delta);
+    print_frame_number(&canvas);
+    print_player_data(&canvas, &player);
+    print_lurker_data(&canvas, &arena.lurkers);
+    print_level_data(&canvas, level_seed, regeneration_ns);
+    print_profiler(&canvas, &profiler);
+    begin_profile_stage(&profiler, PROFILE_REFRESH);
     refresh();
+    end_profile_stage(&profiler, PROFILE_REFRESH);
+    reset_bump_allocator(&arena.scratch_memory);
+    /* The sleep would be all that's left of a spike, it isn't counted */
+    end_profile_frame(&profiler);
 
-    end = clock();
-    time_delta = ((float)(end - start)) / CLOCKS_PER_SEC;
+    sleep_until_ns(frame_start + frame_ns);
+    frame_delta = (now_ns() - frame_start) / 1e9f;
+    previous_frame_start = frame_start;
   }
 
 end_game_loop:
 
-  free(arena.data);
-  free(arena.lurkers);
-  free(canvas.data);
+  free_job_system(&jobs);
+  free_arena(&arena);
+  free_canvas(&canvas);
 
   getch();
   endwin();
 
+  if (gen_status != ARENA_GENERATION_OK) {
+    printf("Warning: only %u rooms fit into the arena.\n",
+           arena.room_seed_count);
+  }
+
+  if (profile_path) {
+    uint path_length = strlen(profile_path);
+    byte is_trace = path_length >= 5 &&
+                    strcmp(profile_path + path_length - 5, ".json") == 0;
+    byte is_saved = is_trace ? save_profile_trace(&profiler, profile_path)
+                             : save_profile_csv(&profiler, profile_path);
+    if (!is_saved) {
+      printf("Couldn't save the profile to %s.\n", profile_path);
+    }
+  }
+  free_profiler(&profiler);
+
   printf("\nGame ended by player input.\n");
+  printf("Seed: %u\n", seed);
   fflush(stdout);
 
   return 0;
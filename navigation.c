@@ -0,0 +1,542 @@
+#include "navigation.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "utils.h"
+
+const int FLOW_DIRECTION_X[FLOW_NONE] = {1, 1, 0, -1, -1, -1, 0, 1};
+const int FLOW_DIRECTION_Y[FLOW_NONE] = {0, 1, 1, 1, 0, -1, -1, -1};
+
+const uint FLOW_FIELD_RADIUS = 96;
+const uint FLOW_UNREACHABLE = (uint)-1;
+
+void init_flow_field(FlowField* field) {
+  field->target_x = 0;
+  field->target_y = 0;
+  field->offset_x = 0;
+  field->offset_y = 0;
+  field->size_x = 0;
+  field->size_y = 0;
+  field->capacity = 0;
+  field->distance = NULL;
+  field->direction = NULL;
+  field->arena_generation = 0;
+  field->is_valid = 0;
+  field->last_used = 0;
+}
+
+void free_flow_field(FlowField* field) {
+  free(field->distance);
+  free(field->direction);
+  init_flow_field(field);
+}
+
+void build_flow_field(FlowField* field, Arena* arena, uint target_x,
+                      uint target_y) {
+  field->target_x = target_x;
+  field->target_y = target_y;
+  field->offset_x = target_x > FLOW_FIELD_RADIUS ? target_x - FLOW_FIELD_RADIUS
+                                                 : 0;
+  field->offset_y = target_y > FLOW_FIELD_RADIUS ? target_y - FLOW_FIELD_RADIUS
+                                                 : 0;
+  uint end_x = target_x + FLOW_FIELD_RADIUS + 1;
+  uint end_y = target_y + FLOW_FIELD_RADIUS + 1;
+  end_x = end_x < arena->size_x ? end_x : arena->size_x;
+  end_y = end_y < arena->size_y ? end_y : arena->size_y;
+  field->size_x = end_x - field->offset_x;
+  field->size_y = end_y - field->offset_y;
+  field->arena_generation = arena->data_generation;
+  field->is_valid = 1;
+
+  uint tilecount = field->size_x * field->size_y;
+  if (tilecount > field->capacity) {
+    field->distance = realloc(field->distance, tilecount * sizeof(uint));
+    field->direction = realloc(field->direction, tilecount * sizeof(byte));
+    assert(field->distance && field->direction);
+    field->capacity = tilecount;
+  }
+
+  BumpMark scratch_mark = get_bump_mark(&arena->scratch_memory);
+  byte* is_walkable =
+      bump_alloc(&arena->scratch_memory, tilecount * sizeof(byte));
+  uint* queue = bump_alloc(&arena->scratch_memory, tilecount * sizeof(uint));
+
+  uint x, y, i;
+  for (y = 0; y < field->size_y; y++) {
+    for (x = 0; x < field->size_x; x++) {
+      byte tile =
+          get_arena_tile(arena, field->offset_x + x, field->offset_y + y);
+      is_walkable[x + y * field->size_x] = TILE_PROPERTIES[tile].is_walkable;
+    }
+  }
+
+  for (i = 0; i < tilecount; i++) {
+    field->distance[i] = FLOW_UNREACHABLE;
+    field->direction[i] = FLOW_NONE;
+  }
+
+  uint target = (target_x - field->offset_x) +
+                (target_y - field->offset_y) * field->size_x;
+  uint queue_start = 0, queue_end = 0;
+  if (is_walkable[target]) {
+    field->distance[target] = 0;
+    queue[queue_end++] = target;
+  }
+
+  /* Straight steps first, so that ties prefer them over diagonals */
+  const byte EXPANSION_ORDER[FLOW_NONE] = {
+      FLOW_EAST,       FLOW_SOUTH,      FLOW_WEST,       FLOW_NORTH,
+      FLOW_SOUTH_EAST, FLOW_SOUTH_WEST, FLOW_NORTH_WEST, FLOW_NORTH_EAST,
+  };
+
+  while (queue_start < queue_end) {
+    uint current = queue[queue_start++];
+    int c_x = current % field->size_x;
+    int c_y = current / field->size_x;
+
+    uint order;
+    for (order = 0; order < FLOW_NONE; order++) {
+      byte dir = EXPANSION_ORDER[order];
+      int n_x = c_x + FLOW_DIRECTION_X[dir];
+      int n_y = c_y + FLOW_DIRECTION_Y[dir];
+      if (n_x < 0 || n_y < 0 || n_x >= (int)field->size_x ||
+          n_y >= (int)field->size_y) {
+        continue;
+      }
+
+      uint next = n_x + n_y * field->size_x;
+      if (!is_walkable[next] || field->distance[next] != FLOW_UNREACHABLE) {
+        continue;
+      }
+
+      /* No squeezing diagonally between two walls */
+      if (FLOW_DIRECTION_X[dir] != 0 && FLOW_DIRECTION_Y[dir] != 0 &&
+          (!is_walkable[n_x + c_y * field->size_x] ||
+           !is_walkable[c_x + n_y * field->size_x])) {
+        continue;
+      }
+
+      field->distance[next] = field->distance[current] + 1;
+      /* Back the way the search came, (dir + 4) % 8 is the opposite one */
+      field->direction[next] = (dir + 4) % FLOW_NONE;
+      queue[queue_end++] = next;
+    }
+  }
+
+  rewind_bump_allocator(&arena->scratch_memory, scratch_mark);
+}
+
+byte is_inside_flow_field(FlowField* field, uint x, uint y) {
+  return field->is_valid && x >= field->offset_x && y >= field->offset_y &&
+         x < field->offset_x + field->size_x &&
+         y < field->offset_y + field->size_y;
+}
+
+byte get_flow_direction(FlowField* field, uint x, uint y) {
+  if (!is_inside_flow_field(field, x, y)) {
+    return FLOW_NONE;
+  }
+  return field->direction[(x - field->offset_x) +
+                          (y - field->offset_y) * field->size_x];
+}
+
+uint get_flow_distance(FlowField* field, uint x, uint y) {
+  if (!is_inside_flow_field(field, x, y)) {
+    return FLOW_UNREACHABLE;
+  }
+  return field->distance[(x - field->offset_x) +
+                         (y - field->offset_y) * field->size_x];
+}
+
+void init_flow_field_cache(FlowFieldCache* cache, uint field_count) {
+  cache->fields = malloc(field_count * sizeof(FlowField));
+  assert(cache->fields);
+  cache->field_count = field_count;
+  cache->use_counter = 0;
+
+  uint i;
+  for (i = 0; i < field_count; i++) {
+    init_flow_field(&cache->fields[i]);
+  }
+}
+
+void free_flow_field_cache(FlowFieldCache* cache) {
+  uint i;
+  for (i = 0; i < cache->field_count; i++) {
+    free_flow_field(&cache->fields[i]);
+  }
+  free(cache->fields);
+  cache->fields = NULL;
+  cache->field_count = 0;
+}
+
+FlowField* get_flow_field(FlowFieldCache* cache, Arena* arena, uint target_x,
+                          uint target_y) {
+  cache->use_counter += 1;
+
+  FlowField* oldest = &cache->fields[0];
+  uint i;
+  for (i = 0; i < cache->field_count; i++) {
+    FlowField* field = &cache->fields[i];
+    if (field->is_valid && field->target_x == target_x &&
+        field->target_y == target_y) {
+      if (field->arena_generation != arena->data_generation) {
+        build_flow_field(field, arena, target_x, target_y);
+      }
+      field->last_used = cache->use_counter;
+      return field;
+    }
+
+    if (!field->is_valid ||
+        (oldest->is_valid && field->last_used < oldest->last_used)) {
+      oldest = field;
+    }
+  }
+
+  build_flow_field(oldest, arena, target_x, target_y);
+  oldest->last_used = cache->use_counter;
+  return oldest;
+}
+
+const uint NO_ROOM_PATH = (uint)-1;
+const uint DOORWAY_NOT_PLANNED = (uint)-2;
+/* Entries per room, rounded up to a power of two */
+const uint ROOM_PATH_ENTRIES_PER_ROOM = 4;
+const uint ROOM_PATH_CACHE_WAYS = 4;
+/* Parent of the states leaving the start room */
+const uint NO_ROOM_STATE = (uint)-1;
+
+void init_room_path_cache(RoomPathCache* cache, uint room_count) {
+  cache->entry_shift = 12;
+  while ((1u << cache->entry_shift) < room_count * ROOM_PATH_ENTRIES_PER_ROOM &&
+         cache->entry_shift < 24) {
+    cache->entry_shift += 1;
+  }
+  cache->entries = calloc(1u << cache->entry_shift, sizeof(RoomPathEntry));
+  assert(cache->entries);
+  cache->use_counter = 0;
+  cache->search_budget = (uint)-1;
+  cache->state_capacity = 0;
+  cache->cost = NULL;
+  cache->parent = NULL;
+  cache->stamp = NULL;
+  cache->current_stamp = 0;
+  cache->room_capacity = 0;
+  cache->room_stamp = NULL;
+  cache->heap_f = NULL;
+  cache->heap_state = NULL;
+  cache->heap_capacity = 0;
+}
+
+void free_room_path_cache(RoomPathCache* cache) {
+  free(cache->entries);
+  free(cache->cost);
+  free(cache->parent);
+  free(cache->stamp);
+  free(cache->room_stamp);
+  free(cache->heap_f);
+  free(cache->heap_state);
+  cache->entries = NULL;
+  cache->state_capacity = 0;
+  cache->cost = NULL;
+  cache->parent = NULL;
+  cache->stamp = NULL;
+  cache->room_capacity = 0;
+  cache->room_stamp = NULL;
+  cache->heap_f = NULL;
+  cache->heap_state = NULL;
+  cache->heap_capacity = 0;
+}
+
+void get_doorway_end(DoorwaySeed* door, uint room, uint* x, uint* y) {
+  *x = room == door->room_a ? door->a_x : door->b_x;
+  *y = room == door->room_a ? door->a_y : door->b_y;
+}
+
+float get_octile_distance(uint x0, uint y0, uint x1, uint y1) {
+  const float DIAGONAL_EXTRA = 0.41421356f;
+  uint d_x = x0 > x1 ? x0 - x1 : x1 - x0;
+  uint d_y = y0 > y1 ? y0 - y1 : y1 - y0;
+  return d_x > d_y ? d_x + DIAGONAL_EXTRA * d_y : d_y + DIAGONAL_EXTRA * d_x;
+}
+
+/* Straight line, never more than the octile distance, so A* stays optimal */
+float get_room_path_heuristic(uint x, uint y, RoomSeed* target) {
+  float d_x = (float)x - target->center_x;
+  float d_y = (float)y - target->center_y;
+  return sqrt(d_x * d_x + d_y * d_y);
+}
+
+void push_room_state(RoomPathCache* cache, uint* count, float f, uint state) {
+  if (*count == cache->heap_capacity) {
+    cache->heap_capacity = cache->heap_capacity ? cache->heap_capacity * 2 : 64;
+    cache->heap_f =
+        realloc(cache->heap_f, cache->heap_capacity * sizeof(float));
+    cache->heap_state =
+        realloc(cache->heap_state, cache->heap_capacity * sizeof(uint));
+    assert(cache->heap_f && cache->heap_state);
+  }
+
+  uint i = (*count)++;
+  while (i > 0 && cache->heap_f[(i - 1) / 2] > f) {
+    cache->heap_f[i] = cache->heap_f[(i - 1) / 2];
+    cache->heap_state[i] = cache->heap_state[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  cache->heap_f[i] = f;
+  cache->heap_state[i] = state;
+}
+
+uint pop_room_state(RoomPathCache* cache, uint* count) {
+  uint top = cache->heap_state[0];
+  *count -= 1;
+  float f = cache->heap_f[*count];
+  uint state = cache->heap_state[*count];
+
+  uint i = 0;
+  while (i * 2 + 1 < *count) {
+    uint child = i * 2 + 1;
+    if (child + 1 < *count && cache->heap_f[child + 1] < cache->heap_f[child]) {
+      child += 1;
+    }
+    if (cache->heap_f[child] >= f) {
+      break;
+    }
+    cache->heap_f[i] = cache->heap_f[child];
+    cache->heap_state[i] = cache->heap_state[child];
+    i = child;
+  }
+  cache->heap_f[i] = f;
+  cache->heap_state[i] = state;
+  return top;
+}
+
+/* Stamp of a state that has been reached, one more once it is expanded */
+void relax_room_state(RoomPathCache* cache, uint* heap_count, uint state,
+                      float cost, float heuristic, uint parent) {
+  if (cache->stamp[state] == cache->current_stamp + 1 ||
+      (cache->stamp[state] == cache->current_stamp &&
+       cache->cost[state] <= cost)) {
+    return;
+  }
+  cache->stamp[state] = cache->current_stamp;
+  cache->cost[state] = cost;
+  cache->parent[state] = parent;
+  push_room_state(cache, heap_count, cost + heuristic, state);
+}
+
+/* Every way out of room from (x, y), which it was entered through
+// entered_doorway, and the goal if this is the target room.
+*/
+void expand_room_state(RoomPathCache* cache, Arena* arena, uint* heap_count,
+                       uint room, uint x, uint y, float cost,
+                       uint entered_doorway, uint state, uint to_room) {
+  RoomSeed* target = &arena->room_seeds[to_room];
+  uint goal = arena->doorway_count * 2;
+
+  if (room == to_room) {
+    relax_room_state(
+        cache, heap_count, goal,
+        cost + get_octile_distance(x, y, target->center_x, target->center_y),
+        0, state);
+  }
+
+  uint i;
+  for (i = arena->room_doorway_start[room];
+       i < arena->room_doorway_start[room + 1]; i++) {
+    uint door_idx = arena->room_doorways[i];
+    if (door_idx == entered_doorway) {
+      continue;
+    }
+
+    DoorwaySeed* door = &arena->doorways[door_idx];
+    uint next_room = room == door->room_a ? door->room_b : door->room_a;
+    uint near_x, near_y, far_x, far_y;
+    get_doorway_end(door, room, &near_x, &near_y);
+    get_doorway_end(door, next_room, &far_x, &far_y);
+
+    float next_cost = cost + get_octile_distance(x, y, near_x, near_y) +
+                      get_octile_distance(near_x, near_y, far_x, far_y);
+    relax_room_state(cache, heap_count,
+                     door_idx * 2 + (next_room == door->room_a ? 0 : 1),
+                     next_cost, get_room_path_heuristic(far_x, far_y, target),
+                     state);
+  }
+}
+
+/* Next doorway cache slot, the first of ROOM_PATH_CACHE_WAYS entries a room
+// pair can be kept in.
+*/
+RoomPathEntry* get_room_path_set(RoomPathCache* cache, uint from_room,
+                                 uint to_room) {
+  /* Fibonacci hashing, the top bits are the well mixed ones */
+  uint hash = (from_room * 2654435761u ^ to_room) * 2654435761u;
+  return &cache->entries[(hash >> (32 - cache->entry_shift)) &
+                         ~(ROOM_PATH_CACHE_WAYS - 1)];
+}
+
+byte is_room_path_entry_for(RoomPathEntry* entry, Arena* arena,
+                            uint from_room, uint to_room) {
+  return entry->is_valid && entry->from_room == from_room &&
+         entry->to_room == to_room &&
+         entry->arena_generation == arena->data_generation;
+}
+
+void set_room_path_entry(RoomPathCache* cache, Arena* arena, uint from_room,
+                         uint to_room, uint next_doorway) {
+  RoomPathEntry* set = get_room_path_set(cache, from_room, to_room);
+  RoomPathEntry* entry = &set[0];
+  uint i;
+  for (i = 0; i < ROOM_PATH_CACHE_WAYS; i++) {
+    if (is_room_path_entry_for(&set[i], arena, from_room, to_room)) {
+      entry = &set[i];
+      break;
+    }
+    if (!set[i].is_valid ||
+        set[i].arena_generation != arena->data_generation) {
+      entry = &set[i];
+    } else if (entry->is_valid &&
+               entry->arena_generation == arena->data_generation &&
+               set[i].last_used < entry->last_used) {
+      entry = &set[i];
+    }
+  }
+
+  entry->from_room = from_room;
+  entry->to_room = to_room;
+  entry->next_doorway = next_doorway;
+  entry->arena_generation = arena->data_generation;
+  entry->last_used = cache->use_counter;
+  entry->is_valid = 1;
+}
+
+/* A* over (doorway, room it leads into) states, leaves the path in
+// cache->parent, walking back from the goal state.
+// Searching from the target room instead, with cached_to_room set to it,
+// every state that gets expanded also has its best way back to the target
+// known. Its room then gets its next doorway cached, at most once per
+// search, so one search serves lurkers from all rooms it went through.
+*/
+byte search_room_path(RoomPathCache* cache, Arena* arena, uint from_room,
+                      uint to_room, uint cached_to_room) {
+  uint state_count = arena->doorway_count * 2 + 1;
+  uint goal = state_count - 1;
+  if (state_count > cache->state_capacity) {
+    cache->cost = realloc(cache->cost, state_count * sizeof(float));
+    cache->parent = realloc(cache->parent, state_count * sizeof(uint));
+    cache->stamp = realloc(cache->stamp, state_count * sizeof(uint));
+    assert(cache->cost && cache->parent && cache->stamp);
+    cache->state_capacity = state_count;
+    cache->current_stamp = (uint)-2;
+  }
+
+  if (arena->room_seed_count > cache->room_capacity) {
+    cache->room_stamp = realloc(cache->room_stamp,
+                                arena->room_seed_count * sizeof(uint));
+    assert(cache->room_stamp);
+    cache->room_capacity = arena->room_seed_count;
+    cache->current_stamp = (uint)-2;
+  }
+
+  /* Two stamps per search, reached and expanded */
+  cache->current_stamp += 2;
+  if (cache->current_stamp < 2) {
+    memset(cache->stamp, 0, cache->state_capacity * sizeof(uint));
+    memset(cache->room_stamp, 0, cache->room_capacity * sizeof(uint));
+    cache->current_stamp = 2;
+  }
+
+  uint heap_count = 0;
+  RoomSeed* from = &arena->room_seeds[from_room];
+  expand_room_state(cache, arena, &heap_count, from_room, from->center_x,
+                    from->center_y, 0, NO_DOORWAY, NO_ROOM_STATE, to_room);
+
+  while (heap_count > 0) {
+    uint state = pop_room_state(cache, &heap_count);
+    if (cache->stamp[state] != cache->current_stamp) {
+      continue;
+    }
+    if (state == goal) {
+      return 1;
+    }
+    cache->stamp[state] = cache->current_stamp + 1;
+
+    uint door_idx = state / 2;
+    DoorwaySeed* door = &arena->doorways[door_idx];
+    uint room = state % 2 ? door->room_b : door->room_a;
+    if (cached_to_room != NO_ROOM &&
+        cache->room_stamp[room] != cache->current_stamp) {
+      cache->room_stamp[room] = cache->current_stamp;
+      set_room_path_entry(cache, arena, room, cached_to_room, door_idx);
+    }
+
+    uint x, y;
+    get_doorway_end(door, room, &x, &y);
+    expand_room_state(cache, arena, &heap_count, room, x, y,
+                      cache->cost[state], door_idx, state, to_room);
+  }
+
+  return 0;
+}
+
+uint find_room_path(RoomPathCache* cache, Arena* arena, uint from_room,
+                    uint to_room, uint* doorways, uint capacity) {
+  if (!search_room_path(cache, arena, from_room, to_room, NO_ROOM)) {
+    return NO_ROOM_PATH;
+  }
+
+  uint goal = arena->doorway_count * 2;
+  uint count = 0;
+  uint state;
+  for (state = cache->parent[goal]; state != NO_ROOM_STATE;
+       state = cache->parent[state]) {
+    count += 1;
+  }
+
+  uint i = count;
+  for (state = cache->parent[goal]; state != NO_ROOM_STATE;
+       state = cache->parent[state]) {
+    i -= 1;
+    if (i < capacity) {
+      doorways[i] = state / 2;
+    }
+  }
+
+  return count;
+}
+
+uint get_next_doorway(RoomPathCache* cache, Arena* arena, uint from_room,
+                      uint to_room) {
+  if (from_room == to_room) {
+    return NO_DOORWAY;
+  }
+
+  cache->use_counter += 1;
+  RoomPathEntry* set = get_room_path_set(cache, from_room, to_room);
+  uint i;
+  for (i = 0; i < ROOM_PATH_CACHE_WAYS; i++) {
+    if (is_room_path_entry_for(&set[i], arena, from_room, to_room)) {
+      set[i].last_used = cache->use_counter;
+      return set[i].next_doorway;
+    }
+  }
+
+  if (cache->search_budget == 0) {
+    return DOORWAY_NOT_PLANNED;
+  }
+  cache->search_budget -= 1;
+
+  /* Backwards, see search_room_path. The goal is reached from a state in
+  // from_room, whose doorway leads on towards to_room.
+  */
+  uint next_doorway = NO_DOORWAY;
+  if (search_room_path(cache, arena, to_room, from_room, to_room)) {
+    next_doorway = cache->parent[arena->doorway_count * 2] / 2;
+  }
+  set_room_path_entry(cache, arena, from_room, to_room, next_doorway);
+  return next_doorway;
+}
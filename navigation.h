@@ -0,0 +1,145 @@
+#ifndef NAVIGATION_H
+#define NAVIGATION_H
+
+#include "arena.h"
+#include "utils.h"
+
+/* Flow fields, one BFS from a target tile tells every tile around it which
+// way to step to get closer. Any number of lurkers heading for the same
+// target share one field and look their next step up in O(1).
+// A field only covers a window of FLOW_FIELD_RADIUS around its target,
+// tiles outside of it have no direction.
+*/
+
+enum FlowDirection {
+  FLOW_EAST = 0,
+  FLOW_SOUTH_EAST,
+  FLOW_SOUTH,
+  FLOW_SOUTH_WEST,
+  FLOW_WEST,
+  FLOW_NORTH_WEST,
+  FLOW_NORTH,
+  FLOW_NORTH_EAST,
+  /* Unreachable, outside of the field, or the target itself */
+  FLOW_NONE,
+};
+
+/* Step of every FlowDirection, the azimuth of direction d is d * PI / 4 */
+extern const int FLOW_DIRECTION_X[FLOW_NONE];
+extern const int FLOW_DIRECTION_Y[FLOW_NONE];
+
+typedef struct {
+  uint target_x, target_y;
+  uint offset_x, offset_y;
+  uint size_x, size_y;
+  uint capacity;
+  /* Steps to the target, FLOW_UNREACHABLE if there is no path */
+  uint* distance;
+  /* enum FlowDirection of every tile */
+  byte* direction;
+  uint arena_generation;
+  byte is_valid;
+  /* FlowFieldCache use counter value when last handed out, for eviction */
+  uint last_used;
+} FlowField;
+
+extern const uint FLOW_FIELD_RADIUS;
+extern const uint FLOW_UNREACHABLE;
+
+void init_flow_field(FlowField* field);
+void free_flow_field(FlowField* field);
+
+/* 8-connected BFS over walkable tiles, diagonal steps can't cut corners */
+void build_flow_field(FlowField* field, Arena* arena, uint target_x,
+                      uint target_y);
+
+byte get_flow_direction(FlowField* field, uint x, uint y);
+uint get_flow_distance(FlowField* field, uint x, uint y);
+
+/* Recently used fields, keyed by target tile. A field is rebuilt once the
+// map changes, the least recently used one is replaced when all are taken.
+*/
+typedef struct {
+  FlowField* fields;
+  uint field_count;
+  uint use_counter;
+} FlowFieldCache;
+
+void init_flow_field_cache(FlowFieldCache* cache, uint field_count);
+void free_flow_field_cache(FlowFieldCache* cache);
+
+FlowField* get_flow_field(FlowFieldCache* cache, Arena* arena, uint target_x,
+                          uint target_y);
+
+/* Hierarchical pathfinding over the room graph, HPA* style. Doorways are
+// the abstract nodes, crossing a room between two of its doorways costs the
+// octile distance, which is exact as rooms are empty rectangles. Paths are
+// planned room to room from the rooms' centers and cached per room pair,
+// only the leg inside the current room is ever refined down to tiles.
+*/
+
+extern const uint NO_ROOM_PATH;
+/* get_next_doorway ran out of RoomPathCache.search_budget */
+extern const uint DOORWAY_NOT_PLANNED;
+
+typedef struct {
+  uint from_room, to_room;
+  /* First doorway of the path, NO_DOORWAY if there is no path */
+  uint next_doorway;
+  uint arena_generation;
+  /* RoomPathCache use counter value when last used, for eviction */
+  uint last_used;
+  byte is_valid;
+} RoomPathEntry;
+
+typedef struct {
+  /* 1 << entry_shift of them, set associative by room pair, least recently
+  // used entries go first.
+  */
+  RoomPathEntry* entries;
+  uint entry_shift;
+  uint use_counter;
+  /* Searches get_next_doorway may still run, refill it every tick to put
+  // a bound on planning time.
+  */
+  uint search_budget;
+  /* A* scratch, two states per doorway (which room it was entered into)
+  // plus the goal. A state counts as visited when its stamp is current.
+  */
+  uint state_capacity;
+  float* cost;
+  uint* parent;
+  uint* stamp;
+  uint current_stamp;
+  uint room_capacity;
+  uint* room_stamp;
+  /* Binary min-heap of (f, state), stale entries are skipped when popped */
+  float* heap_f;
+  uint* heap_state;
+  uint heap_capacity;
+} RoomPathCache;
+
+/* End of the doorway's corridor on room's side, a floor tile of room */
+void get_doorway_end(DoorwaySeed* door, uint room, uint* x, uint* y);
+
+/* Sized for an arena with room_count rooms, with an unlimited budget */
+void init_room_path_cache(RoomPathCache* cache, uint room_count);
+void free_room_path_cache(RoomPathCache* cache);
+
+/* A* from from_room's center to to_room's center. Writes up to capacity
+// doorways of the path in order, returns the doorway count of the whole
+// path, or NO_ROOM_PATH if the rooms aren't connected.
+*/
+uint find_room_path(RoomPathCache* cache, Arena* arena, uint from_room,
+                    uint to_room, uint* doorways, uint capacity);
+
+/* Doorway to leave from_room through to get to to_room, NO_DOORWAY if the
+// rooms are the same or not connected, DOORWAY_NOT_PLANNED if that takes
+// a search and the budget is spent. A search caches the next doorway of
+// every room it went through, so lurkers heading for the same room share
+// most of the planning.
+*/
+uint get_next_doorway(RoomPathCache* cache, Arena* arena, uint from_room,
+                      uint to_room);
+
+#endif
@@ -4,8 +4,13 @@
 #include "utils.h"
 
 void draw_player(Canvas* canvas, Arena* arena) {
-  uint c_pos = arena->player->position_x * canvas->scale_x +
-               arena->player->position_y * canvas->scale_y * canvas->size_x;
+  if (!is_tile_in_view(&canvas->view, arena->player->position_x,
+                       arena->player->position_y)) {
+    return;
+  }
+
+  uint c_pos = get_canvas_index(canvas, arena->player->position_x,
+                                arena->player->position_y);
 
   /* TODO: Same for y */
   uint x_off;
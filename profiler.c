@@ -0,0 +1,144 @@
+#include "profiler.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timing.h"
+#include "utils.h"
+
+const char* PROFILE_STAGE_NAMES[PROFILE_STAGE_COUNT] = {
+    "stream_chunks",    "update_lurkers", "draw_arena",   "draw_player",
+    "draw_lurker_rays", "draw_lurkers",   "print_canvas", "refresh",
+};
+
+void init_profiler(Profiler* profiler) {
+  profiler->frames = calloc(PROFILE_FRAME_COUNT, sizeof(ProfileFrame));
+  profiler->events = calloc(PROFILE_EVENT_COUNT, sizeof(ProfileEvent));
+  assert(profiler->frames && profiler->events);
+  profiler->frame_count = 0;
+  profiler->event_count = 0;
+  memset(profiler->stage_begin_ns, 0, sizeof(profiler->stage_begin_ns));
+  profiler->start_ns = now_ns();
+  profiler->is_overlay_visible = 0;
+}
+
+void free_profiler(Profiler* profiler) {
+  free(profiler->frames);
+  free(profiler->events);
+  profiler->frames = NULL;
+  profiler->events = NULL;
+}
+
+ProfileFrame* get_current_frame(Profiler* profiler) {
+  return &profiler->frames[profiler->frame_count % PROFILE_FRAME_COUNT];
+}
+
+/* Stage PROFILE_STAGE_COUNT stands for the whole frame */
+void add_profile_event(Profiler* profiler, uint stage,
+                       unsigned long begin_ns, unsigned long duration_ns) {
+  ProfileEvent* event =
+      &profiler->events[profiler->event_count % PROFILE_EVENT_COUNT];
+  event->stage = stage;
+  event->begin_ns = begin_ns;
+  event->duration_ns = duration_ns;
+  profiler->event_count += 1;
+}
+
+void begin_profile_frame(Profiler* profiler) {
+  ProfileFrame* frame = get_current_frame(profiler);
+  memset(frame, 0, sizeof(ProfileFrame));
+  frame->begin_ns = now_ns();
+}
+
+void end_profile_frame(Profiler* profiler) {
+  ProfileFrame* frame = get_current_frame(profiler);
+  frame->total_ns = now_ns() - frame->begin_ns;
+  add_profile_event(profiler, PROFILE_STAGE_COUNT, frame->begin_ns,
+                    frame->total_ns);
+  profiler->frame_count += 1;
+}
+
+void begin_profile_stage(Profiler* profiler, uint stage) {
+  profiler->stage_begin_ns[stage] = now_ns();
+}
+
+void end_profile_stage(Profiler* profiler, uint stage) {
+  unsigned long begin_ns = profiler->stage_begin_ns[stage];
+  unsigned long duration_ns = now_ns() - begin_ns;
+  get_current_frame(profiler)->stage_ns[stage] += duration_ns;
+  add_profile_event(profiler, stage, begin_ns, duration_ns);
+}
+
+uint get_profiled_frame_count(Profiler* profiler) {
+  return profiler->frame_count < PROFILE_FRAME_COUNT ? profiler->frame_count
+                                                     : PROFILE_FRAME_COUNT;
+}
+
+ProfileFrame* get_profiled_frame(Profiler* profiler, uint age) {
+  assert(age < get_profiled_frame_count(profiler));
+  return &profiler->frames[(profiler->frame_count - 1 - age) %
+                           PROFILE_FRAME_COUNT];
+}
+
+byte save_profile_csv(Profiler* profiler, const char* path) {
+  FILE* file = fopen(path, "w");
+  if (!file) {
+    return 0;
+  }
+
+  fprintf(file, "frame,begin_ns,total_ns");
+  uint stage;
+  for (stage = 0; stage < PROFILE_STAGE_COUNT; stage++) {
+    fprintf(file, ",%s_ns", PROFILE_STAGE_NAMES[stage]);
+  }
+  fprintf(file, "\n");
+
+  /* Oldest first */
+  uint count = get_profiled_frame_count(profiler);
+  uint age;
+  for (age = count; age > 0; age--) {
+    ProfileFrame* frame = get_profiled_frame(profiler, age - 1);
+    fprintf(file, "%u,%lu,%lu", profiler->frame_count - age,
+            frame->begin_ns - profiler->start_ns, frame->total_ns);
+    for (stage = 0; stage < PROFILE_STAGE_COUNT; stage++) {
+      fprintf(file, ",%lu", frame->stage_ns[stage]);
+    }
+    fprintf(file, "\n");
+  }
+
+  byte is_ok = !ferror(file);
+  return fclose(file) == 0 && is_ok;
+}
+
+byte save_profile_trace(Profiler* profiler, const char* path) {
+  FILE* file = fopen(path, "w");
+  if (!file) {
+    return 0;
+  }
+
+  /* Stages nest inside their frame as long as they share a thread id */
+  fprintf(file, "{\"traceEvents\":[");
+  uint count = profiler->event_count < PROFILE_EVENT_COUNT
+                   ? profiler->event_count
+                   : PROFILE_EVENT_COUNT;
+  uint i;
+  for (i = profiler->event_count - count; i < profiler->event_count; i++) {
+    ProfileEvent* event = &profiler->events[i % PROFILE_EVENT_COUNT];
+    const char* name = event->stage < PROFILE_STAGE_COUNT
+                           ? PROFILE_STAGE_NAMES[event->stage]
+                           : "frame";
+    /* Trace timestamps are in microseconds */
+    fprintf(file,
+            "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+            "\"ts\":%.3f,\"dur\":%.3f}",
+            i == profiler->event_count - count ? "" : ",", name,
+            (event->begin_ns - profiler->start_ns) / 1000.0,
+            event->duration_ns / 1000.0);
+  }
+  fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+  byte is_ok = !ferror(file);
+  return fclose(file) == 0 && is_ok;
+}
@@ -0,0 +1,79 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "utils.h"
+
+/* Frame time instrumentation. Stages are timed between begin/end markers,
+// a stage may run several times per frame (one update_lurkers per tick),
+// its frame time is the sum. The last PROFILE_FRAME_COUNT frames are kept,
+// for the overlay (see print_profiler) and for dumping to a file once a
+// spike has to be tracked down.
+*/
+
+enum ProfileStage {
+  PROFILE_STREAM_CHUNKS = 0,
+  PROFILE_UPDATE_LURKERS,
+  PROFILE_DRAW_ARENA,
+  PROFILE_DRAW_PLAYER,
+  PROFILE_DRAW_LURKER_RAYS,
+  PROFILE_DRAW_LURKERS,
+  PROFILE_PRINT_CANVAS,
+  PROFILE_REFRESH,
+  PROFILE_STAGE_COUNT,
+};
+
+extern const char* PROFILE_STAGE_NAMES[PROFILE_STAGE_COUNT];
+
+enum {
+  PROFILE_FRAME_COUNT = 256,
+  /* Individual stage runs kept for traces, the oldest are overwritten */
+  PROFILE_EVENT_COUNT = 8192,
+};
+
+typedef struct {
+  unsigned long begin_ns;
+  /* Begin to end of the frame, including time spent outside of stages */
+  unsigned long total_ns;
+  unsigned long stage_ns[PROFILE_STAGE_COUNT];
+} ProfileFrame;
+
+typedef struct {
+  uint stage;
+  unsigned long begin_ns, duration_ns;
+} ProfileEvent;
+
+typedef struct {
+  /* Rings, frame n is frames[n % PROFILE_FRAME_COUNT], same for events */
+  ProfileFrame* frames;
+  uint frame_count;
+  ProfileEvent* events;
+  uint event_count;
+  unsigned long stage_begin_ns[PROFILE_STAGE_COUNT];
+  /* Zero point of the timestamps in dumps */
+  unsigned long start_ns;
+  byte is_overlay_visible;
+} Profiler;
+
+void init_profiler(Profiler* profiler);
+void free_profiler(Profiler* profiler);
+
+void begin_profile_frame(Profiler* profiler);
+void end_profile_frame(Profiler* profiler);
+void begin_profile_stage(Profiler* profiler, uint stage);
+void end_profile_stage(Profiler* profiler, uint stage);
+
+/* Completed frames still kept, at most PROFILE_FRAME_COUNT */
+uint get_profiled_frame_count(Profiler* profiler);
+/* age 0 is the last completed frame, has to be below the count above */
+ProfileFrame* get_profiled_frame(Profiler* profiler, uint age);
+
+/* Writes the kept frames, one row per frame with every stage in columns,
+// times in nanoseconds. Returns 0 if the file couldn't be written.
+*/
+byte save_profile_csv(Profiler* profiler, const char* path);
+/* Writes the kept stage runs as Chrome trace events, for chrome://tracing
+// or Perfetto. Returns 0 if the file couldn't be written.
+*/
+byte save_profile_trace(Profiler* profiler, const char* path);
+
+#endif
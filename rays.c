@@ -1,67 +1,146 @@
 #include "rays.h"
 
-#include <math.h>
+#include <stdlib.h>
 
 #include "arena.h"
 #include "canvas.h"
 #include "colors.h"
+#include "jobs.h"
+#include "view.h"
+#include "visibility.h"
 
-const float DETECTION_RAYS = 50;
+/* Cones are only recomputed when a lurker's pose or the map changes,
+// otherwise the cached field is just painted again.
+*/
+VisibilityCache ray_visibility_cache = {NULL, 0};
 
-void draw_lurker_rays(Canvas* canvas, Arena* arena) {
-  Lurker* lurkers = arena->lurkers;
-  uint lurker_count = arena->lurker_count;
+typedef struct {
+  Canvas* canvas;
+  Arena* arena;
+  /* Lurkers whose cone can reach into view */
+  uint* lurker_indices;
+  uint lurker_count;
+  uint job_count;
+} RayJobs;
 
-  /* Lurker rays have special drawing requirements:
-  // - They have to operate on the final canvas for higher resolution
-  // - They have to collide with visual walls, not their abstract notations.
-  //   - Otherwise we'll have the rays clip fine edges (e.g. 0.1 pos diff).
-  */
+void run_visibility_job(void* context, uint job_idx) {
+  RayJobs* rays = context;
+  uint begin, end, i;
+  get_job_range(job_idx, rays->job_count, rays->lurker_count, 1, &begin,
+                &end);
+  for (i = begin; i < end; i++) {
+    get_lurker_visibility(&ray_visibility_cache, rays->arena,
+                          rays->lurker_indices[i]);
+  }
+}
 
+/* Lurkers whose field window overlaps the view, the same window
+// compute_visibility uses. Cones entirely off-screen aren't even computed.
+*/
+uint find_lurkers_in_view(Canvas* canvas, Arena* arena, uint* lurker_indices) {
+  Lurkers* lurkers = &arena->lurkers;
+  uint count = 0;
   uint i;
-  for (i = 0; i < lurker_count; i++) {
-    Lurker* lurker = &lurkers[i];
-    float pos_x = lurker->position_x;
-    float pos_y = lurker->position_y;
-    float heading = lurker->azimuth_current_rad;
-
-    /* TODO: sin and cos of delta between rays can be precomputed,
-    //       then applied to a unit vec of the heading
-    */
-
-    float min = heading - lurker->detection_cone_halfangle_rad;
-    float max = heading + lurker->detection_cone_halfangle_rad;
-    float span = max - min;
-    float delta = span / DETECTION_RAYS;
-    float ray_step = 0.4;
-
-    float angle;
-    for (angle = min; angle < max; angle += delta) {
-      float ray_x = pos_x * canvas->scale_x;
-      float ray_y = pos_y * canvas->scale_y;
-      float vel_x = cos(angle) * ray_step;
-      float vel_y = sin(angle) * ray_step;
-
-      CanvasTile* tile =
-          &canvas->data[(uint)ray_x + (uint)ray_y * canvas->size_x];
-
-      /* TODO: Maybe add max beam range? Don't do iter (!), just compute diag
-      //
-      */
-
-      while (tile->can_light_pass) {
-        tile->display_char = '+';
-        tile->color_code = RAY_COLOR_CODE;
-
-        tile = &canvas->data[(uint)ray_x + (uint)ray_y * canvas->size_x];
-        ray_x += vel_x * canvas->scale_x;
-        ray_y += vel_y * canvas->scale_y;
-
-        if (ray_x <= 0 || ray_x >= arena->size_x - 1 || /**/
-            ray_y <= 0 || ray_y >= arena->size_y - 1) {
-          break;
+  for (i = 0; i < lurkers->count; i++) {
+    int x = (int)lurkers->position_x[i];
+    int y = (int)lurkers->position_y[i];
+    float range = lurkers->detection_range[i];
+    int reach = range > 0 ? (int)range + 1
+                          : (int)(arena->size_x + arena->size_y);
+    if (is_rect_in_view(&canvas->view, x - reach, y - reach, x + reach + 1,
+                        y + reach + 1)) {
+      lurker_indices[count++] = i;
+    }
+  }
+  return count;
+}
+
+/* Paints the part of the field within arena rows [row_begin, row_end) that
+// is in view.
+*/
+void paint_field_rows(Canvas* canvas, VisibilityField* field, uint row_begin,
+                      uint row_end) {
+  row_begin = row_begin > field->offset_y ? row_begin : field->offset_y;
+  row_end = row_end < field->offset_y + field->size_y
+                ? row_end
+                : field->offset_y + field->size_y;
+  if (row_begin >= row_end) {
+    return;
+  }
+
+  uint bit_begin = (row_begin - field->offset_y) * field->size_x;
+  uint bit_end = (row_end - field->offset_y) * field->size_x;
+
+  /* Walks the bitset directly, most of a window is empty and whole
+  // empty bytes can be skipped at once.
+  */
+  uint byte_idx, bit, x_off;
+  for (byte_idx = bit_begin / 8; byte_idx < (bit_end + 7) / 8; byte_idx++) {
+    byte bits = field->bits[byte_idx];
+    for (bit = 0; bits; bit++, bits >>= 1) {
+      uint idx = byte_idx * 8 + bit;
+      if (!(bits & 1) || idx < bit_begin || idx >= bit_end) {
+        continue;
+      }
+
+      uint x = field->offset_x + idx % field->size_x;
+      uint y = field->offset_y + idx / field->size_x;
+      if (!is_tile_in_view(&canvas->view, x, y)) {
+        continue;
+      }
+
+      uint c_pos = get_canvas_index(canvas, x, y);
+
+      for (x_off = 0; x_off < canvas->scale_x; x_off++) {
+        CanvasTile* tile = &canvas->data[c_pos + x_off];
+        if (tile->can_light_pass) {
+          tile->display_char = '+';
+          tile->color_code = RAY_COLOR_CODE;
         }
       }
     }
   }
 }
+
+/* Every job paints all fields, but only within its own band of rows, so
+// no two jobs ever write the same canvas tile.
+*/
+void run_paint_job(void* context, uint job_idx) {
+  RayJobs* rays = context;
+  View* view = &rays->canvas->view;
+  uint row_begin, row_end, i;
+  get_job_range(job_idx, rays->job_count, view->size_y, 1, &row_begin,
+                &row_end);
+  for (i = 0; i < rays->lurker_count; i++) {
+    uint lurker_idx = rays->lurker_indices[i];
+    paint_field_rows(rays->canvas,
+                     &ray_visibility_cache.entries[lurker_idx].field,
+                     view->offset_y + row_begin, view->offset_y + row_end);
+  }
+}
+
+void draw_lurker_rays(Canvas* canvas, Arena* arena, JobSystem* jobs) {
+  /* Cones are computed on the arena grid by visibility.c, then painted onto
+  // every canvas tile of each visible arena tile. Canvas tiles that already
+  // block light (walls, player) are left untouched.
+  */
+  const uint MIN_LURKERS_PER_JOB = 4;
+  const uint MIN_ROWS_PER_JOB = 8;
+
+  RayJobs rays;
+  rays.canvas = canvas;
+  rays.arena = arena;
+  /* Dropped with the rest of the frame's scratch */
+  rays.lurker_indices =
+      bump_alloc(&arena->scratch_memory, arena->lurkers.count * sizeof(uint));
+  rays.lurker_count =
+      find_lurkers_in_view(canvas, arena, rays.lurker_indices);
+
+  reserve_visibility_cache(&ray_visibility_cache, arena->lurkers.count);
+  rays.job_count = get_job_count(jobs, rays.lurker_count, MIN_LURKERS_PER_JOB);
+  run_jobs(jobs, run_visibility_job, &rays, rays.job_count);
+
+  rays.job_count =
+      get_job_count(jobs, canvas->view.size_y, MIN_ROWS_PER_JOB);
+  run_jobs(jobs, run_paint_job, &rays, rays.job_count);
+}
@@ -3,7 +3,8 @@
 
 #include "arena.h"
 #include "canvas.h"
+#include "jobs.h"
 
-void draw_lurker_rays(Canvas* canvas, Arena* arena);
+void draw_lurker_rays(Canvas* canvas, Arena* arena, JobSystem* jobs);
 
 #endif
@@ -0,0 +1,130 @@
+#include "rng.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "utils.h"
+
+uint rotl32(uint x, int k) { return (x << k) | (x >> (32 - k)); }
+
+/* Bit mixer from https://github.com/skeeto/hash-prospector, any input
+// (including 0) maps to a well distributed output.
+*/
+uint mix32(uint x) {
+  x ^= x >> 16;
+  x *= 0x7feb352dU;
+  x ^= x >> 15;
+  x *= 0x846ca68bU;
+  x ^= x >> 16;
+  return x;
+}
+
+void seed_rng(Rng* rng, uint seed, uint stream) {
+  /* Splitmix style, consecutive steps of a Weyl sequence through a mixer,
+  // so nearby seeds and stream ids still give unrelated states.
+  */
+  uint x = mix32(seed) ^ mix32(stream * 0x9e3779b9U + 0x632be5abU);
+  int i;
+  for (i = 0; i < 4; i++) {
+    x += 0x9e3779b9U;
+    rng->s[i] = mix32(x);
+  }
+
+  if ((rng->s[0] | rng->s[1] | rng->s[2] | rng->s[3]) == 0) {
+    rng->s[0] = 1;
+  }
+}
+
+uint rand_u32(Rng* rng) {
+  uint* s = rng->s;
+  uint result = rotl32(s[1] * 5, 7) * 9;
+  uint t = s[1] << 9;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl32(s[3], 11);
+
+  return result;
+}
+
+float rand_f(Rng* rng, float min, float max) {
+  /* Top 24 bits, exactly what a float mantissa can hold, gives [0, 1) */
+  float unit = (rand_u32(rng) >> 8) * (1.0f / 16777216);
+  return unit * (max - min) + min;
+}
+
+uint rand_ui(Rng* rng, uint min, uint max) {
+  return rand_u32(rng) % (max - min) + min;
+}
+
+void fill_rand_f(Rng* rng, float* out, uint count, float min, float max) {
+  uint i;
+  for (i = 0; i < count; i++) {
+    out[i] = rand_f(rng, min, max);
+  }
+}
+
+void fill_rand_ui(Rng* rng, uint* out, uint count, uint min, uint max) {
+  uint i;
+  for (i = 0; i < count; i++) {
+    out[i] = rand_ui(rng, min, max);
+  }
+}
+
+void fill_rand_f_lanes(uint** state, float* out, uint count, float min,
+                       float max) {
+  uint i = 0;
+
+#ifdef __SSE2__
+  /* rand_u32 and rand_f on 4 generators, the multiplications are done as
+  // shifts and adds (SSE2 has no 32 bit multiply), results are identical.
+  */
+  __m128 scale = _mm_set1_ps(1.0f / 16777216);
+  __m128 range = _mm_set1_ps(max - min);
+  __m128 offset = _mm_set1_ps(min);
+  for (; i + 4 <= count; i += 4) {
+    __m128i s0 = _mm_loadu_si128((__m128i*)(state[0] + i));
+    __m128i s1 = _mm_loadu_si128((__m128i*)(state[1] + i));
+    __m128i s2 = _mm_loadu_si128((__m128i*)(state[2] + i));
+    __m128i s3 = _mm_loadu_si128((__m128i*)(state[3] + i));
+
+    __m128i times_5 = _mm_add_epi32(s1, _mm_slli_epi32(s1, 2));
+    __m128i rotated = _mm_or_si128(_mm_slli_epi32(times_5, 7),
+                                   _mm_srli_epi32(times_5, 25));
+    __m128i result = _mm_add_epi32(rotated, _mm_slli_epi32(rotated, 3));
+    __m128i t = _mm_slli_epi32(s1, 9);
+
+    s2 = _mm_xor_si128(s2, s0);
+    s3 = _mm_xor_si128(s3, s1);
+    s1 = _mm_xor_si128(s1, s2);
+    s0 = _mm_xor_si128(s0, s3);
+    s2 = _mm_xor_si128(s2, t);
+    s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+
+    _mm_storeu_si128((__m128i*)(state[0] + i), s0);
+    _mm_storeu_si128((__m128i*)(state[1] + i), s1);
+    _mm_storeu_si128((__m128i*)(state[2] + i), s2);
+    _mm_storeu_si128((__m128i*)(state[3] + i), s3);
+
+    __m128 unit =
+        _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(result, 8)), scale);
+    _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(unit, range), offset));
+  }
+#endif
+
+  for (; i < count; i++) {
+    Rng rng;
+    int k;
+    for (k = 0; k < 4; k++) {
+      rng.s[k] = state[k][i];
+    }
+    out[i] = rand_f(&rng, min, max);
+    for (k = 0; k < 4; k++) {
+      state[k][i] = rng.s[k];
+    }
+  }
+}
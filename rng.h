@@ -0,0 +1,36 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include "utils.h"
+
+/* xoshiro128** generator, https://prng.di.unimi.it/
+// All randomness goes through explicit Rng states instead of libc rand(),
+// so a run is fully determined by its seed, and separate streams (one for
+// generation, one per lurker) don't depend on each other's call order.
+// Needs a 32 bit uint.
+*/
+typedef struct {
+  uint s[4];
+} Rng;
+
+/* Streams with the same seed but a different stream id are independent */
+void seed_rng(Rng* rng, uint seed, uint stream);
+
+uint rand_u32(Rng* rng);
+
+/* In [min, max) */
+float rand_f(Rng* rng, float min, float max);
+uint rand_ui(Rng* rng, uint min, uint max);
+
+/* Same as calling rand_f / rand_ui count times */
+void fill_rand_f(Rng* rng, float* out, uint count, float min, float max);
+void fill_rand_ui(Rng* rng, uint* out, uint count, uint min, uint max);
+
+/* count separate generators stored as a structure of arrays, word k of
+// generator i is state[k][i]. Writes one rand_f of every generator to out,
+// several generators are stepped at once where SSE2 is available.
+*/
+void fill_rand_f_lanes(uint** state, float* out, uint count, float min,
+                       float max);
+
+#endif
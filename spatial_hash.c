@@ -0,0 +1,176 @@
+#include "spatial_hash.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+
+const uint SPATIAL_HASH_CELL_SHIFT = 3;
+
+void init_spatial_hash(SpatialHash* hash) {
+  hash->count = 0;
+  hash->bucket_shift = 0;
+  hash->bucket_start = NULL;
+  hash->items = NULL;
+  hash->item_bucket = NULL;
+  hash->bucket_capacity = 0;
+  hash->item_capacity = 0;
+}
+
+void free_spatial_hash(SpatialHash* hash) {
+  free(hash->bucket_start);
+  free(hash->items);
+  free(hash->item_bucket);
+  init_spatial_hash(hash);
+}
+
+uint get_cell_coord(float pos) { return (uint)pos >> SPATIAL_HASH_CELL_SHIFT; }
+
+uint get_cell_bucket(SpatialHash* hash, uint cell_x, uint cell_y) {
+  /* Fibonacci hashing, the top bits are the well mixed ones */
+  uint key = (cell_x * 2654435761u ^ cell_y) * 2654435761u;
+  return hash->bucket_shift ? key >> (32 - hash->bucket_shift) : 0;
+}
+
+void build_spatial_hash(SpatialHash* hash, const float* pos_x,
+                        const float* pos_y, uint count) {
+  /* About one bucket per point, fewer would only lengthen the scans */
+  const uint MIN_BUCKET_SHIFT = 4;
+
+  hash->count = count;
+  hash->bucket_shift = MIN_BUCKET_SHIFT;
+  while ((1u << hash->bucket_shift) < count && hash->bucket_shift < 24) {
+    hash->bucket_shift += 1;
+  }
+
+  uint bucket_count = 1u << hash->bucket_shift;
+  if (bucket_count + 1 > hash->bucket_capacity) {
+    hash->bucket_capacity = bucket_count + 1;
+    hash->bucket_start = realloc(hash->bucket_start,
+                                 hash->bucket_capacity * sizeof(uint));
+    assert(hash->bucket_start);
+  }
+  if (count > hash->item_capacity) {
+    hash->item_capacity = count;
+    hash->items = realloc(hash->items, count * sizeof(uint));
+    hash->item_bucket = realloc(hash->item_bucket, count * sizeof(uint));
+    assert(hash->items && hash->item_bucket);
+  }
+
+  /* Counting sort, bucket_start[b + 1] first counts the points in b */
+  memset(hash->bucket_start, 0, (bucket_count + 1) * sizeof(uint));
+  uint i;
+  for (i = 0; i < count; i++) {
+    uint bucket = get_cell_bucket(hash, get_cell_coord(pos_x[i]),
+                                  get_cell_coord(pos_y[i]));
+    hash->item_bucket[i] = bucket;
+    hash->bucket_start[bucket + 1] += 1;
+  }
+
+  uint b;
+  for (b = 0; b < bucket_count; b++) {
+    hash->bucket_start[b + 1] += hash->bucket_start[b];
+  }
+
+  /* Filling moves every start to the next bucket's, shifted back after */
+  for (i = 0; i < count; i++) {
+    hash->items[hash->bucket_start[hash->item_bucket[i]]++] = i;
+  }
+  for (b = bucket_count; b > 0; b--) {
+    hash->bucket_start[b] = hash->bucket_start[b - 1];
+  }
+  hash->bucket_start[0] = 0;
+}
+
+/* Shared by both queries, radius2 < 0 tests the rect, the rect is only used
+// to pick cells otherwise.
+*/
+uint query_spatial_hash(SpatialHash* hash, const float* pos_x,
+                        const float* pos_y, float min_x, float min_y,
+                        float max_x, float max_y, float center_x,
+                        float center_y, float radius2, uint* results,
+                        uint capacity) {
+  uint found = 0;
+
+  if (max_x < 0 || max_y < 0 || max_x < min_x || max_y < min_y) {
+    return 0;
+  }
+
+  uint min_cell_x = get_cell_coord(min_x < 0 ? 0 : min_x);
+  uint min_cell_y = get_cell_coord(min_y < 0 ? 0 : min_y);
+  uint max_cell_x = get_cell_coord(max_x);
+  uint max_cell_y = get_cell_coord(max_y);
+  /* Rects spanning more cells than there are buckets read every bucket
+  // anyway, and would read a few of them more than once.
+  */
+  float cell_count =
+      (float)(max_cell_x - min_cell_x + 1) * (max_cell_y - min_cell_y + 1);
+  byte is_scan = cell_count > (float)(1u << hash->bucket_shift);
+
+  uint cell_x = min_cell_x;
+  uint cell_y = min_cell_y;
+  while (1) {
+    uint begin = 0;
+    uint end = hash->count;
+    if (!is_scan) {
+      uint bucket = get_cell_bucket(hash, cell_x, cell_y);
+      begin = hash->bucket_start[bucket];
+      end = hash->bucket_start[bucket + 1];
+    }
+
+    uint k;
+    for (k = begin; k < end; k++) {
+      uint i = is_scan ? k : hash->items[k];
+      float x = pos_x[i];
+      float y = pos_y[i];
+
+      /* Other cells share the bucket, they are visited on their own */
+      if (!is_scan &&
+          (get_cell_coord(x) != cell_x || get_cell_coord(y) != cell_y)) {
+        continue;
+      }
+      if (radius2 < 0 ? x < min_x || x >= max_x || y < min_y || y >= max_y
+                      : (x - center_x) * (x - center_x) +
+                                (y - center_y) * (y - center_y) >
+                            radius2) {
+        continue;
+      }
+
+      if (found < capacity) {
+        results[found] = i;
+      }
+      found += 1;
+    }
+
+    if (is_scan) {
+      break;
+    }
+    if (cell_x < max_cell_x) {
+      cell_x += 1;
+    } else if (cell_y < max_cell_y) {
+      cell_x = min_cell_x;
+      cell_y += 1;
+    } else {
+      break;
+    }
+  }
+
+  return found;
+}
+
+uint find_points_in_rect(SpatialHash* hash, const float* pos_x,
+                         const float* pos_y, float min_x, float min_y,
+                         float max_x, float max_y, uint* results,
+                         uint capacity) {
+  return query_spatial_hash(hash, pos_x, pos_y, min_x, min_y, max_x, max_y, 0,
+                            0, -1, results, capacity);
+}
+
+uint find_points_in_radius(SpatialHash* hash, const float* pos_x,
+                           const float* pos_y, float x, float y, float radius,
+                           uint* results, uint capacity) {
+  return query_spatial_hash(hash, pos_x, pos_y, x - radius, y - radius,
+                            x + radius, y + radius, x, y, radius * radius,
+                            results, capacity);
+}
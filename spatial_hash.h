@@ -0,0 +1,50 @@
+#ifndef SPATIAL_HASH_H
+#define SPATIAL_HASH_H
+
+#include "utils.h"
+
+/* Points bucketed by the square cell of tiles they are in, for neighbour
+// queries that don't scan every point. Cells are hashed into about as many
+// buckets as there are points, so memory scales with the point count and not
+// with the arena. Rebuilt from scratch with build_spatial_hash, a full
+// rebuild is a counting sort, cheaper than tracking moves.
+// Positions aren't copied, queries take the same arrays the hash was built
+// from, they have to be left unchanged in between.
+*/
+typedef struct {
+  uint count;
+  /* log2 of the bucket count */
+  uint bucket_shift;
+  /* Bucket b holds items[bucket_start[b]] .. items[bucket_start[b + 1]] */
+  uint* bucket_start;
+  uint* items;
+  /* Scratch for the rebuild, bucket of every point */
+  uint* item_bucket;
+  uint bucket_capacity, item_capacity;
+} SpatialHash;
+
+/* Cells are 1 << SPATIAL_HASH_CELL_SHIFT tiles on a side */
+extern const uint SPATIAL_HASH_CELL_SHIFT;
+
+void init_spatial_hash(SpatialHash* hash);
+void free_spatial_hash(SpatialHash* hash);
+
+/* Point i is at (pos_x[i], pos_y[i]), coordinates can't be negative */
+void build_spatial_hash(SpatialHash* hash, const float* pos_x,
+                        const float* pos_y, uint count);
+
+/* Queries write the indices of matching points to results, up to capacity of
+// them, in no particular order. They return how many match in total.
+*/
+
+/* Points with min <= pos < max on both axes */
+uint find_points_in_rect(SpatialHash* hash, const float* pos_x,
+                         const float* pos_y, float min_x, float min_y,
+                         float max_x, float max_y, uint* results,
+                         uint capacity);
+/* Points at most radius away from (x, y) */
+uint find_points_in_radius(SpatialHash* hash, const float* pos_x,
+                           const float* pos_y, float x, float y, float radius,
+                           uint* results, uint capacity);
+
+#endif
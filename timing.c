@@ -0,0 +1,32 @@
+/* clock_gettime() is POSIX, hidden by -ansi unless requested explicitly */
+#define _POSIX_C_SOURCE 199309L
+
+#include "timing.h"
+
+#include <errno.h>
+#include <time.h>
+
+#include "utils.h"
+
+const uint SIMULATION_HZ = 60;
+
+unsigned long now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long)ts.tv_sec * 1000000000UL + (unsigned long)ts.tv_nsec;
+}
+
+void sleep_until_ns(unsigned long deadline_ns) {
+  unsigned long now = now_ns();
+  if (now >= deadline_ns) {
+    return;
+  }
+
+  struct timespec remaining;
+  remaining.tv_sec = (deadline_ns - now) / 1000000000UL;
+  remaining.tv_nsec = (deadline_ns - now) % 1000000000UL;
+
+  /* Signals (e.g. terminal resizes) cut the sleep short */
+  while (nanosleep(&remaining, &remaining) != 0 && errno == EINTR) {
+  }
+}
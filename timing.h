@@ -0,0 +1,17 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include "utils.h"
+
+/* Simulation ticks per second, every tick advances the game by exactly
+// 1 / SIMULATION_HZ seconds regardless of how fast frames are drawn.
+*/
+extern const uint SIMULATION_HZ;
+
+/* Monotonic wall clock in nanoseconds, origin is arbitrary */
+unsigned long now_ns();
+
+/* Sleeps until now_ns() reaches deadline_ns, returns at once if it has */
+void sleep_until_ns(unsigned long deadline_ns);
+
+#endif
@@ -0,0 +1,37 @@
+#include "view.h"
+
+#include "arena.h"
+#include "utils.h"
+
+void init_view(View* view, Arena* arena, uint size_x, uint size_y) {
+  view->size_x = size_x < arena->size_x ? size_x : arena->size_x;
+  view->size_y = size_y < arena->size_y ? size_y : arena->size_y;
+  view->offset_x = 0;
+  view->offset_y = 0;
+}
+
+void center_view(View* view, Arena* arena, uint x, uint y) {
+  uint half_x = view->size_x / 2;
+  uint half_y = view->size_y / 2;
+  uint max_offset_x = arena->size_x - view->size_x;
+  uint max_offset_y = arena->size_y - view->size_y;
+
+  view->offset_x = x > half_x ? x - half_x : 0;
+  view->offset_y = y > half_y ? y - half_y : 0;
+  view->offset_x = view->offset_x < max_offset_x ? view->offset_x
+                                                 : max_offset_x;
+  view->offset_y = view->offset_y < max_offset_y ? view->offset_y
+                                                 : max_offset_y;
+}
+
+byte is_tile_in_view(View* view, uint x, uint y) {
+  return x >= view->offset_x && y >= view->offset_y &&
+         x < view->offset_x + view->size_x &&
+         y < view->offset_y + view->size_y;
+}
+
+byte is_rect_in_view(View* view, int min_x, int min_y, int max_x, int max_y) {
+  return max_x > (int)view->offset_x && max_y > (int)view->offset_y &&
+         min_x < (int)(view->offset_x + view->size_x) &&
+         min_y < (int)(view->offset_y + view->size_y);
+}
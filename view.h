@@ -1,9 +1,26 @@
+#ifndef VIEW_H
+#define VIEW_H
 
+#include "arena.h"
 #include "utils.h"
 
-/* TODO: This doesn't exist yet, will act as user's camera */
-
+/* The user's camera, the window of arena tiles that is on screen. The canvas
+// only covers the view, so rendering scales with the terminal, not the map.
+*/
 typedef struct {
   uint size_x, size_y;
   uint offset_x, offset_y;
 } View;
+
+/* Sizes are in arena tiles, clamped to the arena */
+void init_view(View* view, Arena* arena, uint size_x, uint size_y);
+
+/* Moves the view to be centered on the tile, as far as the arena allows */
+void center_view(View* view, Arena* arena, uint x, uint y);
+
+byte is_tile_in_view(View* view, uint x, uint y);
+
+/* Whether the rect min <= x < max, same for y, overlaps the view */
+byte is_rect_in_view(View* view, int min_x, int min_y, int max_x, int max_y);
+
+#endif
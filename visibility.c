@@ -0,0 +1,478 @@
+#include "visibility.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "lurker.h"
+#include "utils.h"
+
+/* Symmetric shadowcasting, see https://www.albertford.com/shadowcasting/
+// The area around the origin is split into 4 quadrants, each scanned row by
+// row outwards. Slopes are kept as exact fractions so that tiles exactly on
+// a shadow edge are classified the same way regardless of direction, which
+// is what makes the result gap-free and symmetric.
+*/
+
+enum Quadrant {
+  QUADRANT_NORTH = 0,
+  QUADRANT_EAST,
+  QUADRANT_SOUTH,
+  QUADRANT_WEST,
+};
+
+typedef struct {
+  int num, den;
+} Slope;
+
+typedef struct {
+  VisibilityField* field;
+  Arena* arena;
+  int origin_x, origin_y;
+  uint quadrant;
+  uint max_depth;
+  /* Cone test, heading is a unit vector */
+  float heading_x, heading_y;
+  float cos_halfangle;
+  /* Squared detection range, 0 for unlimited */
+  float max_range2;
+} ShadowcastState;
+
+int floor_div(int a, int b) {
+  /* b is always positive here */
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/* round(depth * slope), ties rounded up */
+int round_ties_up(int depth, Slope slope) {
+  return floor_div(2 * depth * slope.num + slope.den, 2 * slope.den);
+}
+
+/* round(depth * slope), ties rounded down */
+int round_ties_down(int depth, Slope slope) {
+  return -floor_div(slope.den - 2 * depth * slope.num, 2 * slope.den);
+}
+
+/* Slope of the edge a tile at (depth, col) shares with its left neighbour */
+Slope tile_slope(int depth, int col) {
+  Slope slope;
+  slope.num = 2 * col - 1;
+  slope.den = 2 * depth;
+  return slope;
+}
+
+void quadrant_to_arena(ShadowcastState* state, int depth, int col, int* x,
+                       int* y) {
+  switch (state->quadrant) {
+    case QUADRANT_NORTH:
+      *x = state->origin_x + col;
+      *y = state->origin_y - depth;
+      break;
+    case QUADRANT_SOUTH:
+      *x = state->origin_x + col;
+      *y = state->origin_y + depth;
+      break;
+    case QUADRANT_EAST:
+      *x = state->origin_x + depth;
+      *y = state->origin_y + col;
+      break;
+    case QUADRANT_WEST:
+      *x = state->origin_x - depth;
+      *y = state->origin_y + col;
+      break;
+  }
+}
+
+byte is_inside_field(VisibilityField* field, int x, int y) {
+  return x >= (int)field->offset_x && y >= (int)field->offset_y &&
+         x < (int)(field->offset_x + field->size_x) &&
+         y < (int)(field->offset_y + field->size_y);
+}
+
+/* Out of field tiles are treated as walls, they stop the scan */
+byte is_opaque(ShadowcastState* state, int x, int y) {
+  if (!is_inside_field(state->field, x, y)) {
+    return 1;
+  }
+  byte tile = get_arena_tile(state->arena, x, y);
+  return !TILE_PROPERTIES[tile].can_light_pass;
+}
+
+byte is_inside_cone(ShadowcastState* state, int x, int y) {
+  float d_x = x - state->origin_x;
+  float d_y = y - state->origin_y;
+  float dot = d_x * state->heading_x + d_y * state->heading_y;
+  float len2 = d_x * d_x + d_y * d_y;
+  float cos2 = state->cos_halfangle * state->cos_halfangle;
+
+  if (state->max_range2 > 0 && len2 > state->max_range2) {
+    return 0;
+  }
+
+  /* dot >= |d| * cos_halfangle without the sqrt */
+  if (state->cos_halfangle >= 0) {
+    return dot >= 0 && dot * dot >= len2 * cos2;
+  }
+  return dot >= 0 || dot * dot <= len2 * cos2;
+}
+
+void reveal(ShadowcastState* state, int x, int y) {
+  VisibilityField* field = state->field;
+
+  if (!is_inside_field(field, x, y) || !is_inside_cone(state, x, y)) {
+    return;
+  }
+
+  uint idx = (x - field->offset_x) + (y - field->offset_y) * field->size_x;
+  field->bits[idx >> 3] |= 1 << (idx & 7);
+}
+
+void scan_row(ShadowcastState* state, int depth, Slope start, Slope end) {
+  if (depth > (int)state->max_depth) {
+    return;
+  }
+
+  int min_col = round_ties_up(depth, start);
+  int max_col = round_ties_down(depth, end);
+
+  /* -1: no previous tile yet, 0: floor, 1: wall */
+  int prev_opaque = -1;
+  int col, x, y;
+  for (col = min_col; col <= max_col; col++) {
+    quadrant_to_arena(state, depth, col, &x, &y);
+    byte opaque = is_opaque(state, x, y);
+
+    /* Floor tiles are only revealed when inside the symmetric slope range */
+    byte is_symmetric = col * start.den >= depth * start.num &&
+                        col * end.den <= depth * end.num;
+
+    if (opaque || is_symmetric) {
+      reveal(state, x, y);
+    }
+
+    if (prev_opaque == 1 && !opaque) {
+      start = tile_slope(depth, col);
+    }
+
+    if (prev_opaque == 0 && opaque) {
+      scan_row(state, depth + 1, start, tile_slope(depth, col));
+    }
+
+    prev_opaque = opaque;
+  }
+
+  if (prev_opaque == 0) {
+    scan_row(state, depth + 1, start, end);
+  }
+}
+
+/* Precision of cone edge slopes, they are rounded outwards to this */
+const int CONE_SLOPE_DEN = 4096;
+
+/* Narrows a quadrant's scan to the slopes the cone covers. Scanning a wedge
+// only slightly wider than the cone is exact, as every tile in the cone is
+// only ever seen along a line that lies inside the cone as well.
+// Returns 0 if the cone doesn't reach the quadrant at all.
+*/
+byte get_cone_slopes(ShadowcastState* state, float heading_rad,
+                     float halfangle_rad, Slope* start, Slope* end) {
+  /* Arena y grows downwards, so north is -PI/2 */
+  const float QUADRANT_AZIMUTHS[] = {-PI / 2, 0, PI / 2, PI};
+  /* Whether increasing col turns clockwise (towards growing azimuth) */
+  const float COL_DIRECTIONS[] = {1, 1, -1, -1};
+
+  start->num = -1;
+  start->den = 1;
+  end->num = 1;
+  end->den = 1;
+
+  /* Wedges over 180deg aren't convex, they are only limited per tile */
+  if (halfangle_rad > PI / 2) {
+    return 1;
+  }
+
+  float rel = heading_rad - QUADRANT_AZIMUTHS[state->quadrant];
+  rel = (rel - floor(rel / (2 * PI) + 0.5) * 2 * PI) *
+        COL_DIRECTIONS[state->quadrant];
+
+  float lo = rel - halfangle_rad;
+  float hi = rel + halfangle_rad;
+
+  if (lo > PI / 4 || hi < -PI / 4) {
+    return 0;
+  }
+
+  if (lo > -PI / 4) {
+    start->num = (int)floor(tan(lo) * CONE_SLOPE_DEN);
+    start->den = CONE_SLOPE_DEN;
+  }
+
+  if (hi < PI / 4) {
+    end->num = (int)ceil(tan(hi) * CONE_SLOPE_DEN);
+    end->den = CONE_SLOPE_DEN;
+  }
+
+  return 1;
+}
+
+void init_visibility_field(VisibilityField* field) {
+  field->offset_x = 0;
+  field->offset_y = 0;
+  field->size_x = 0;
+  field->size_y = 0;
+  field->capacity = 0;
+  field->bits = NULL;
+}
+
+void free_visibility_field(VisibilityField* field) {
+  free(field->bits);
+  init_visibility_field(field);
+}
+
+void compute_visibility(VisibilityField* field, Arena* arena, int origin_x,
+                        int origin_y, float heading_rad, float halfangle_rad,
+                        float range) {
+  /* Window covering everything within range, clamped to the arena */
+  uint reach = range > 0 ? (uint)range + 1
+                   : arena->size_x + arena->size_y;
+  int min_x = origin_x - (int)reach;
+  int min_y = origin_y - (int)reach;
+  int max_x = origin_x + (int)reach;
+  int max_y = origin_y + (int)reach;
+  min_x = min_x < 0 ? 0 : min_x;
+  min_y = min_y < 0 ? 0 : min_y;
+  max_x = max_x >= (int)arena->size_x ? (int)arena->size_x - 1 : max_x;
+  max_y = max_y >= (int)arena->size_y ? (int)arena->size_y - 1 : max_y;
+
+  field->offset_x = min_x;
+  field->offset_y = min_y;
+  field->size_x = max_x - min_x + 1;
+  field->size_y = max_y - min_y + 1;
+
+  uint bytes = (field->size_x * field->size_y + 7) / 8;
+  if (bytes > field->capacity) {
+    field->capacity = bytes;
+    field->bits = realloc(field->bits, field->capacity);
+    assert(field->bits);
+  }
+  memset(field->bits, 0, bytes);
+
+  ShadowcastState state;
+  state.field = field;
+  state.arena = arena;
+  state.origin_x = origin_x;
+  state.origin_y = origin_y;
+  state.max_depth = reach;
+  state.heading_x = cos(heading_rad);
+  state.heading_y = sin(heading_rad);
+  state.cos_halfangle = cos(halfangle_rad);
+  state.max_range2 = range * range;
+
+  /* The origin is always visible, the cone test is undefined for it */
+  uint origin_idx = (origin_x - min_x) + (origin_y - min_y) * field->size_x;
+  field->bits[origin_idx >> 3] |= 1 << (origin_idx & 7);
+
+  Slope start, end;
+  uint quadrant;
+  for (quadrant = QUADRANT_NORTH; quadrant <= QUADRANT_WEST; quadrant++) {
+    state.quadrant = quadrant;
+    if (get_cone_slopes(&state, heading_rad, halfangle_rad, &start, &end)) {
+      scan_row(&state, 1, start, end);
+    }
+  }
+}
+
+void compute_lurker_visibility(VisibilityField* field, Arena* arena,
+                               uint lurker_idx) {
+  Lurkers* lurkers = &arena->lurkers;
+  compute_visibility(field, arena, (int)lurkers->position_x[lurker_idx],
+                     (int)lurkers->position_y[lurker_idx],
+                     lurkers->azimuth_current_rad[lurker_idx],
+                     lurkers->detection_cone_halfangle_rad[lurker_idx],
+                     lurkers->detection_range[lurker_idx]);
+}
+
+byte is_tile_visible(VisibilityField* field, uint x, uint y) {
+  if (!is_inside_field(field, x, y)) {
+    return 0;
+  }
+  uint idx = (x - field->offset_x) + (y - field->offset_y) * field->size_x;
+  return (field->bits[idx >> 3] >> (idx & 7)) & 1;
+}
+
+/* The shadowcast scans the quadrant the target is in row by row, a wall
+// shades exactly the slopes strictly between its two edges, so the line
+// between the tile centers is blocked iff on some row in between it passes
+// less than half a tile from the center of a wall.
+// A line through the edge two tiles share gets past a wall on one side of
+// it, but is from then on an edge of the lit slopes. Once it bounds them
+// from both sides, no tile is left to carry it past such a row.
+*/
+byte is_opaque_at(Arena* arena, int from_x, int from_y, byte is_along_x,
+                  int step, int depth, int col) {
+  int x = is_along_x ? from_x + step * depth : from_x + col;
+  int y = is_along_x ? from_y + col : from_y + step * depth;
+  return !TILE_PROPERTIES[get_arena_tile(arena, x, y)].can_light_pass;
+}
+
+byte is_line_of_sight_clear(Arena* arena, int from_x, int from_y, int to_x,
+                            int to_y) {
+  int d_x = to_x - from_x;
+  int d_y = to_y - from_y;
+  byte is_along_x = abs(d_x) >= abs(d_y);
+  int depth = is_along_x ? abs(d_x) : abs(d_y);
+  int col = is_along_x ? d_y : d_x;
+  int step = (is_along_x ? d_x : d_y) > 0 ? 1 : -1;
+  byte is_start_edge = 0;
+  byte is_end_edge = 0;
+
+  int d;
+  for (d = 1; d < depth; d++) {
+    /* Tile the line passes closest to the center of on this row */
+    int c = floor_div(2 * d * col + depth, 2 * depth);
+    byte is_opaque =
+        is_opaque_at(arena, from_x, from_y, is_along_x, step, d, c);
+
+    if (abs(2 * d * col - 2 * c * depth) < depth) {
+      if (is_opaque) {
+        return 0;
+      }
+      continue;
+    }
+
+    /* Passes between c - 1 and c, a wall on c makes it the end edge, a wall
+    // on c - 1 the start edge
+    */
+    is_end_edge |= is_opaque;
+    is_start_edge |=
+        is_opaque_at(arena, from_x, from_y, is_along_x, step, d, c - 1);
+    if (is_start_edge && is_end_edge) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+byte lurker_can_see(Arena* arena, uint lurker_idx, uint x, uint y) {
+  Lurkers* lurkers = &arena->lurkers;
+  int origin_x = (int)lurkers->position_x[lurker_idx];
+  int origin_y = (int)lurkers->position_y[lurker_idx];
+  float d_x = (int)x - origin_x;
+  float d_y = (int)y - origin_y;
+  float len2 = d_x * d_x + d_y * d_y;
+  float range = lurkers->detection_range[lurker_idx];
+
+  if (range > 0 && len2 > range * range) {
+    return 0;
+  }
+
+  /* Same test as is_inside_cone, the origin itself is always seen */
+  if (len2 == 0) {
+    return 1;
+  }
+
+  float azimuth = lurkers->azimuth_current_rad[lurker_idx];
+  float heading_x = cos(azimuth);
+  float heading_y = sin(azimuth);
+  float dot = d_x * heading_x + d_y * heading_y;
+  float cos_halfangle = cos(lurkers->detection_cone_halfangle_rad[lurker_idx]);
+  float cos2 = cos_halfangle * cos_halfangle;
+  byte is_in_cone = cos_halfangle >= 0
+                        ? dot >= 0 && dot * dot >= len2 * cos2
+                        : dot >= 0 || dot * dot <= len2 * cos2;
+  if (!is_in_cone) {
+    return 0;
+  }
+
+  return is_line_of_sight_clear(arena, origin_x, origin_y, x, y);
+}
+
+uint find_lurkers_seeing(Arena* arena, uint x, uint y, uint* lurker_indices,
+                         uint capacity) {
+  uint count = 0;
+  uint i;
+  for (i = 0; i < arena->lurkers.count; i++) {
+    if (lurker_can_see(arena, i, x, y)) {
+      if (count < capacity) {
+        lurker_indices[count] = i;
+      }
+      count += 1;
+    }
+  }
+  return count;
+}
+
+const uint AZIMUTH_BUCKETS = 128;
+
+void init_visibility_cache(VisibilityCache* cache) {
+  cache->entries = NULL;
+  cache->entry_count = 0;
+}
+
+void free_visibility_cache(VisibilityCache* cache) {
+  uint i;
+  for (i = 0; i < cache->entry_count; i++) {
+    free_visibility_field(&cache->entries[i].field);
+  }
+  free(cache->entries);
+  init_visibility_cache(cache);
+}
+
+void reserve_visibility_cache(VisibilityCache* cache, uint lurker_count) {
+  if (lurker_count <= cache->entry_count) {
+    return;
+  }
+
+  cache->entries =
+      realloc(cache->entries, lurker_count * sizeof(VisibilityCacheEntry));
+  assert(cache->entries);
+
+  uint i;
+  for (i = cache->entry_count; i < lurker_count; i++) {
+    cache->entries[i].is_valid = 0;
+    init_visibility_field(&cache->entries[i].field);
+  }
+  cache->entry_count = lurker_count;
+}
+
+VisibilityField* get_lurker_visibility(VisibilityCache* cache, Arena* arena,
+                                       uint lurker_idx) {
+  reserve_visibility_cache(cache, lurker_idx + 1);
+
+  Lurkers* lurkers = &arena->lurkers;
+  VisibilityCacheEntry* entry = &cache->entries[lurker_idx];
+  float halfangle_rad = lurkers->detection_cone_halfangle_rad[lurker_idx];
+  float range = lurkers->detection_range[lurker_idx];
+
+  float turns = lurkers->azimuth_current_rad[lurker_idx] / (2 * PI);
+  turns -= floor(turns);
+  uint bucket = (uint)(turns * AZIMUTH_BUCKETS) % AZIMUTH_BUCKETS;
+
+  int tile_x = (int)lurkers->position_x[lurker_idx];
+  int tile_y = (int)lurkers->position_y[lurker_idx];
+
+  if (entry->is_valid && entry->tile_x == tile_x && entry->tile_y == tile_y &&
+      entry->azimuth_bucket == bucket &&
+      entry->halfangle_rad == halfangle_rad && entry->range == range &&
+      entry->arena_generation == arena->data_generation) {
+    return &entry->field;
+  }
+
+  /* Computed for the bucket's center, so the result only depends on the key */
+  float heading_rad = (bucket + 0.5f) * 2 * PI / AZIMUTH_BUCKETS;
+  compute_visibility(&entry->field, arena, tile_x, tile_y, heading_rad,
+                     halfangle_rad, range);
+
+  entry->tile_x = tile_x;
+  entry->tile_y = tile_y;
+  entry->azimuth_bucket = bucket;
+  entry->halfangle_rad = halfangle_rad;
+  entry->range = range;
+  entry->arena_generation = arena->data_generation;
+  entry->is_valid = 1;
+
+  return &entry->field;
+}
@@ -0,0 +1,78 @@
+#ifndef VISIBILITY_H
+#define VISIBILITY_H
+
+#include "arena.h"
+#include "lurker.h"
+#include "utils.h"
+
+/* Set of arena tiles a lurker can see, as a bitset over a window of the
+// arena. The window only spans the lurker's reach, so computing and clearing
+// a field doesn't scale with the map size when detection_range is set.
+// A field is reusable, its buffer only ever grows.
+*/
+typedef struct {
+  uint offset_x, offset_y;
+  uint size_x, size_y;
+  uint capacity;
+  byte* bits;
+} VisibilityField;
+
+/* Last computed field of every lurker, indexed like Arena.lurkers.
+// An entry is reused as long as the lurker stays on the same tile, within the
+// same azimuth bucket, with the same cone, and the map hasn't been modified.
+*/
+typedef struct {
+  int tile_x, tile_y;
+  uint azimuth_bucket;
+  float halfangle_rad;
+  float range;
+  uint arena_generation;
+  byte is_valid;
+  VisibilityField field;
+} VisibilityCacheEntry;
+
+typedef struct {
+  VisibilityCacheEntry* entries;
+  uint entry_count;
+} VisibilityCache;
+
+void init_visibility_field(VisibilityField* field);
+void free_visibility_field(VisibilityField* field);
+
+void compute_visibility(VisibilityField* field, Arena* arena, int origin_x,
+                        int origin_y, float heading_rad, float halfangle_rad,
+                        float range);
+void compute_lurker_visibility(VisibilityField* field, Arena* arena,
+                               uint lurker_idx);
+byte is_tile_visible(VisibilityField* field, uint x, uint y);
+
+/* Simulation side detection, reads the arena and never touches a canvas.
+// Agrees with compute_visibility on floor tiles, one passes exactly when the
+// shadowcast from the same pose would reveal it, but only the one line
+// between the two tiles is walked instead of the whole cone.
+*/
+byte is_line_of_sight_clear(Arena* arena, int from_x, int from_y, int to_x,
+                            int to_y);
+/* Range, then cone, then occlusion, cheapest test first */
+byte lurker_can_see(Arena* arena, uint lurker_idx, uint x, uint y);
+/* Indices of every lurker that sees the tile, up to capacity of them.
+// Returns how many see it in total.
+*/
+uint find_lurkers_seeing(Arena* arena, uint x, uint y, uint* lurker_indices,
+                         uint capacity);
+
+void init_visibility_cache(VisibilityCache* cache);
+void free_visibility_cache(VisibilityCache* cache);
+
+/* Makes room for lurker_count entries up front. Entries are independent of
+// each other, once reserved, different lurkers can be queried concurrently.
+*/
+void reserve_visibility_cache(VisibilityCache* cache, uint lurker_count);
+
+/* Cached field of a lurker, recomputed only when its key has changed.
+// Headings are quantized to AZIMUTH_BUCKETS for this.
+*/
+VisibilityField* get_lurker_visibility(VisibilityCache* cache, Arena* arena,
+                                       uint lurker_idx);
+
+#endif